@@ -0,0 +1,21 @@
+# RAM and flash per module and buffer, checked against footprint.json:
+# pio run -t footprint
+Import("env")
+
+import os
+
+tool = os.path.join("$PROJECT_DIR", "..", "tools", "footprint.py")
+# arm-none-eabi-gcc -> arm-none-eabi-nm
+nm = env.subst("$CC")[:-len("gcc")] + "nm"
+
+env.AddCustomTarget(
+    name="footprint",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=[
+        '"$PYTHONEXE" "%s" --nm "%s" --src "$PROJECT_SRC_DIR" '
+        '--budget "$PROJECT_DIR/footprint.json" "$BUILD_DIR/${PROGNAME}.elf"'
+        % (tool, nm)
+    ],
+    title="Footprint",
+    description="RAM and flash per module against footprint.json",
+)
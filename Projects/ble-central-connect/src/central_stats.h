@@ -0,0 +1,23 @@
+#ifndef CENTRAL_STATS_H_
+#define CENTRAL_STATS_H_
+
+#include <zephyr/types.h>
+
+// Counters of the central, reported by the "checkpoint stats" command.
+struct central_stats {
+	uint32_t notifications;   // Text notifications received.
+	uint32_t journal_records; // Tap records received.
+	uint32_t relayed;         // Taps received through relays.
+	uint32_t relay_hops;      // Sum of the hop counts of relayed taps.
+	uint32_t relay_age_ms;    // Sum of the time relayed taps spent in relays.
+	uint32_t relay_age_max_ms; // Longest time a relayed tap spent in relays.
+	uint32_t journal_acks;    // Acknowledgements written.
+	uint32_t ack_failures;    // Acknowledgements that could not be sent.
+	uint32_t time_syncs;      // Clock writes sent.
+	uint32_t last_seq;        // Last tap sequence number received.
+	uint8_t connected;        // Checkpoints connected.
+};
+
+void central_stats_get(struct central_stats *stats);
+
+#endif // CENTRAL_STATS_H_
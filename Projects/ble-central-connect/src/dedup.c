@@ -0,0 +1,306 @@
+#include <zephyr.h>
+#include <sys/util.h>
+#include <sys/byteorder.h>
+#include <bluetooth/bluetooth.h>
+
+#include "dedup.h"
+
+#define DEDUP_PEERS 8
+
+// Twice the window keeps the load factor at or below one half.
+#define TABLE_SIZE (2 * DEDUP_WINDOW)
+#define TABLE_MASK (TABLE_SIZE - 1)
+
+BUILD_ASSERT((TABLE_SIZE & TABLE_MASK) == 0, "Table size must be a power of two");
+BUILD_ASSERT(DEDUP_REORDER_DEPTH <= 32, "Held records are tracked in a 32-bit mask");
+
+struct dedup_key {
+	uint32_t seq;
+	uint8_t peer;
+	uint8_t gen;
+	bool used;
+};
+
+struct dedup_peer {
+	bt_addr_le_t addr;
+	bool used;
+	bool started;
+	uint8_t gen;
+	uint32_t next_seq;
+	uint32_t last_use;
+	uint32_t held_mask;
+	int64_t held_since;
+	struct tap_record held[DEDUP_REORDER_DEPTH];
+};
+
+static struct dedup_key table[TABLE_SIZE];
+// Insertion order of the keys in the table, oldest first.
+static struct dedup_key fifo[DEDUP_WINDOW];
+static uint32_t fifo_head;
+static uint32_t fifo_count;
+
+static struct dedup_peer peers[DEDUP_PEERS];
+static uint32_t use_clock;
+
+static struct dedup_stats stats;
+static dedup_emit_t emit_cb;
+static K_MUTEX_DEFINE(dedup_lock);
+
+static void reorder_timeout_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(reorder_work, reorder_timeout_handler);
+
+static uint32_t key_hash(const struct dedup_key *key)
+{
+	uint32_t h = key->seq * 2654435761u;
+
+	h ^= ((uint32_t)key->peer << 8 | key->gen) * 0x9e3779b9u;
+
+	return (h ^ (h >> 16)) & TABLE_MASK;
+}
+
+static bool key_equal(const struct dedup_key *a, const struct dedup_key *b)
+{
+	return a->seq == b->seq && a->peer == b->peer && a->gen == b->gen;
+}
+
+static int table_find(const struct dedup_key *key)
+{
+	uint32_t i = key_hash(key);
+
+	while (table[i].used) {
+		if (key_equal(&table[i], key)) {
+			return i;
+		}
+		i = (i + 1) & TABLE_MASK;
+	}
+
+	return -1;
+}
+
+// Backward-shift deletion keeps probe sequences intact without tombstones.
+static void table_remove(uint32_t i)
+{
+	uint32_t j = i;
+
+	for (;;) {
+		table[i].used = false;
+
+		for (;;) {
+			uint32_t k;
+
+			j = (j + 1) & TABLE_MASK;
+			if (!table[j].used) {
+				return;
+			}
+
+			k = key_hash(&table[j]);
+			// Leave the entry if its home slot lies in (i, j].
+			if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) {
+				continue;
+			}
+			break;
+		}
+
+		table[i] = table[j];
+		i = j;
+	}
+}
+
+static void table_insert(const struct dedup_key *key)
+{
+	uint32_t i;
+
+	if (fifo_count == ARRAY_SIZE(fifo)) {
+		int old = table_find(&fifo[fifo_head]);
+
+		if (old >= 0) {
+			table_remove(old);
+		}
+		fifo_head = (fifo_head + 1) % ARRAY_SIZE(fifo);
+		fifo_count--;
+	}
+
+	i = key_hash(key);
+	while (table[i].used) {
+		i = (i + 1) & TABLE_MASK;
+	}
+	table[i] = *key;
+	table[i].used = true;
+
+	fifo[(fifo_head + fifo_count) % ARRAY_SIZE(fifo)] = *key;
+	fifo_count++;
+}
+
+static struct dedup_peer *peer_get(const bt_addr_le_t *addr)
+{
+	struct dedup_peer *victim = &peers[0];
+
+	for (int i = 0; i < ARRAY_SIZE(peers); i++) {
+		struct dedup_peer *p = &peers[i];
+
+		if (p->used && !bt_addr_le_cmp(&p->addr, addr)) {
+			p->last_use = ++use_clock;
+			return p;
+		}
+		if (!p->used) {
+			if (victim->used) {
+				victim = p;
+			}
+		} else if (victim->used && p->last_use < victim->last_use) {
+			victim = p;
+		}
+	}
+
+	if (victim->used) {
+		// Its keys stay in the table but no longer match the new
+		// generation.
+		stats.evicted++;
+	}
+
+	victim->gen++;
+	victim->used = true;
+	victim->started = false;
+	victim->held_mask = 0;
+	victim->last_use = ++use_clock;
+	bt_addr_le_copy(&victim->addr, addr);
+
+	return victim;
+}
+
+static void emit(const struct dedup_peer *p, const struct tap_record *rec)
+{
+	stats.accepted++;
+	emit_cb(&p->addr, rec);
+}
+
+// Release held records that continue the sequence.
+static void release_consecutive(struct dedup_peer *p)
+{
+	for (;;) {
+		uint32_t slot = p->next_seq % DEDUP_REORDER_DEPTH;
+
+		if (!(p->held_mask & BIT(slot)) ||
+		    sys_le32_to_cpu(p->held[slot].seq) != p->next_seq) {
+			return;
+		}
+
+		p->held_mask &= ~BIT(slot);
+		emit(p, &p->held[slot]);
+		p->next_seq++;
+	}
+}
+
+// Release every held record in order, skipping the missing ones.
+static void release_all(struct dedup_peer *p)
+{
+	while (p->held_mask) {
+		uint32_t slot = p->next_seq % DEDUP_REORDER_DEPTH;
+
+		if ((p->held_mask & BIT(slot)) &&
+		    sys_le32_to_cpu(p->held[slot].seq) == p->next_seq) {
+			p->held_mask &= ~BIT(slot);
+			emit(p, &p->held[slot]);
+		} else {
+			stats.gaps++;
+		}
+		p->next_seq++;
+	}
+}
+
+static void reorder_timeout_handler(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+	int64_t next = 0;
+
+	k_mutex_lock(&dedup_lock, K_FOREVER);
+
+	for (int i = 0; i < ARRAY_SIZE(peers); i++) {
+		struct dedup_peer *p = &peers[i];
+		int64_t due;
+
+		if (!p->used || !p->held_mask) {
+			continue;
+		}
+
+		due = p->held_since + k_ticks_to_ms_ceil64(DEDUP_REORDER_TIMEOUT.ticks);
+		if (due <= now) {
+			release_all(p);
+		} else if (!next || due < next) {
+			next = due;
+		}
+	}
+
+	k_mutex_unlock(&dedup_lock);
+
+	if (next) {
+		k_work_reschedule(&reorder_work, K_MSEC(next - now));
+	}
+}
+
+void dedup_init(dedup_emit_t emit)
+{
+	emit_cb = emit;
+}
+
+bool dedup_submit(const bt_addr_le_t *addr, const struct tap_record *rec)
+{
+	uint32_t seq = sys_le32_to_cpu(rec->seq);
+	struct dedup_key key;
+	struct dedup_peer *p;
+
+	k_mutex_lock(&dedup_lock, K_FOREVER);
+
+	p = peer_get(addr);
+	key.seq = seq;
+	key.peer = p - peers;
+	key.gen = p->gen;
+
+	if (table_find(&key) >= 0) {
+		stats.duplicates++;
+		k_mutex_unlock(&dedup_lock);
+		return false;
+	}
+	table_insert(&key);
+
+	if (!p->started) {
+		p->started = true;
+		p->next_seq = seq;
+	}
+
+	if (seq < p->next_seq) {
+		// Older than the reorder window but not seen: pass it on.
+		emit(p, rec);
+	} else if (seq - p->next_seq >= DEDUP_REORDER_DEPTH) {
+		// Too far ahead to wait for the gap, e.g. after a checkpoint
+		// reset skipped its reserved sequence numbers.
+		release_all(p);
+		stats.gaps += seq - p->next_seq;
+		p->next_seq = seq + 1;
+		emit(p, rec);
+	} else if (seq == p->next_seq) {
+		emit(p, rec);
+		p->next_seq++;
+		release_consecutive(p);
+	} else {
+		uint32_t slot = seq % DEDUP_REORDER_DEPTH;
+
+		if (!p->held_mask) {
+			p->held_since = k_uptime_get();
+			k_work_schedule(&reorder_work, DEDUP_REORDER_TIMEOUT);
+		}
+		p->held[slot] = *rec;
+		p->held_mask |= BIT(slot);
+		stats.reordered++;
+	}
+
+	k_mutex_unlock(&dedup_lock);
+
+	return true;
+}
+
+void dedup_stats_get(struct dedup_stats *out)
+{
+	k_mutex_lock(&dedup_lock, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&dedup_lock);
+}
@@ -0,0 +1,40 @@
+#ifndef DEDUP_H_
+#define DEDUP_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/addr.h>
+
+#include "tap_record.h"
+
+// Duplicate suppression and bounded reordering of tap records.
+//
+// Records are keyed by (checkpoint address, sequence number) in a
+// fixed-size open-addressing hash table holding the most recent
+// DEDUP_WINDOW records. Records that arrive ahead of the next expected
+// sequence number of their checkpoint are held for at most
+// DEDUP_REORDER_DEPTH positions or DEDUP_REORDER_TIMEOUT, then released in
+// order through the emit callback.
+
+#define DEDUP_WINDOW 128
+#define DEDUP_REORDER_DEPTH 8
+#define DEDUP_REORDER_TIMEOUT K_MSEC(100)
+
+typedef void (*dedup_emit_t)(const bt_addr_le_t *peer,
+			     const struct tap_record *rec);
+
+struct dedup_stats {
+	uint32_t accepted;   // Records passed on.
+	uint32_t duplicates; // Records dropped as already seen.
+	uint32_t reordered;  // Records held and released in order.
+	uint32_t gaps;       // Missing sequence numbers skipped.
+	uint32_t evicted;    // Peers dropped to make room.
+};
+
+void dedup_init(dedup_emit_t emit);
+
+// Returns false if the record is a duplicate and has been dropped.
+bool dedup_submit(const bt_addr_le_t *peer, const struct tap_record *rec);
+
+void dedup_stats_get(struct dedup_stats *stats);
+
+#endif // DEDUP_H_
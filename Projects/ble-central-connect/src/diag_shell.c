@@ -0,0 +1,286 @@
+#include <zephyr.h>
+#include <shell/shell.h>
+#include <net/buf.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+#include "latency.h"
+#include "central_stats.h"
+#include "dedup.h"
+#include "fleet.h"
+#include "scan.h"
+#include "trace.h"
+#include "energy.h"
+#include "host_link.h"
+#include "link_phy.h"
+
+// "checkpoint" shell commands for field diagnostics.
+
+struct threads_ctx {
+	const struct shell *sh;
+	uint64_t total_cycles;
+};
+
+static void thread_print(const struct k_thread *cthread, void *user_data)
+{
+	struct k_thread *thread = (struct k_thread *)cthread;
+	struct threads_ctx *ctx = user_data;
+	k_thread_runtime_stats_t rt;
+	size_t unused = 0;
+	const char *name = k_thread_name_get(thread);
+	uint32_t permille = 0;
+
+	if (k_thread_runtime_stats_get(thread, &rt) == 0 && ctx->total_cycles) {
+		permille = (rt.execution_cycles * 1000) / ctx->total_cycles;
+	}
+	(void)k_thread_stack_space_get(thread, &unused);
+
+	shell_print(ctx->sh, "%-16s %4d %10llu %3u.%u%% %5u/%u",
+		    name ? name : "?", thread->base.prio,
+		    k_cyc_to_us_floor64(rt.execution_cycles),
+		    permille / 10, permille % 10,
+		    thread->stack_info.size - unused,
+		    thread->stack_info.size);
+}
+
+static int cmd_threads(const struct shell *sh, size_t argc, char **argv)
+{
+	struct threads_ctx ctx = { .sh = sh };
+	k_thread_runtime_stats_t all;
+
+	if (k_thread_runtime_stats_all_get(&all) == 0) {
+		ctx.total_cycles = all.execution_cycles;
+	}
+
+	shell_print(sh, "%-16s %4s %10s %6s %s", "thread", "prio", "run [us]",
+		    "cpu", "stack used/size");
+	k_thread_foreach_unlocked(thread_print, &ctx);
+
+	return 0;
+}
+
+static int cmd_bufs(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "%-24s %s", "pool", "in use/count");
+	STRUCT_SECTION_FOREACH(net_buf_pool, pool) {
+		int avail = atomic_get(&pool->avail_count);
+
+		shell_print(sh, "%-24s %u/%u", pool->name,
+			    pool->buf_count - avail, pool->buf_count);
+	}
+
+	return 0;
+}
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	struct central_stats st;
+
+	central_stats_get(&st);
+	shell_print(sh, "%u connected, notifications %u, taps %u (last seq %u), "
+		    "relayed %u, acks %u failed %u, time syncs %u",
+		    st.connected, st.notifications,
+		    st.journal_records, st.last_seq, st.relayed, st.journal_acks,
+		    st.ack_failures, st.time_syncs);
+
+	return 0;
+}
+
+static int cmd_energy(const struct shell *sh, size_t argc, char **argv)
+{
+	struct energy_stats st;
+
+	energy_stats_get(&st);
+	shell_print(sh, ENERGY_FMT, ENERGY_ARGS(st));
+
+	return 0;
+}
+
+static int cmd_usb(const struct shell *sh, size_t argc, char **argv)
+{
+	struct host_link_stats st;
+
+	shell_print(sh, "%-7s %-6s %8s %10s %8s %8s %s", "channel", "state",
+		    "lines", "bytes", "dropped", "uart", "slots used/size");
+	for (int i = 0; i < HOST_CHANNEL_COUNT; i++) {
+		host_link_stats_get(i, &st);
+		shell_print(sh, "%-7s %-6s %8u %10u %8u %8u %u/%u",
+			    host_channel_str(i), st.open ? "open" : "closed",
+			    st.lines, st.bytes, st.dropped, st.fallback,
+			    st.used, st.slots);
+	}
+
+	return 0;
+}
+
+static void phy_print(struct bt_conn *conn, void *user_data)
+{
+	const struct shell *sh = user_data;
+	char addr[BT_ADDR_LE_STR_LEN];
+	struct link_phy_info info;
+	int8_t rssi;
+
+	if (link_phy_get(conn, &info)) {
+		return;
+	}
+
+	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	if (link_phy_rssi(conn, &rssi) || rssi == BT_HCI_LE_RSSI_NOT_AVAILABLE) {
+		shell_print(sh, "%s tx %s rx %s changes %u", addr,
+			    link_phy_str(info.tx_phy), link_phy_str(info.rx_phy),
+			    info.changes);
+		return;
+	}
+
+	shell_print(sh, "%s tx %s rx %s changes %u rssi %d dBm", addr,
+		    link_phy_str(info.tx_phy), link_phy_str(info.rx_phy),
+		    info.changes, rssi);
+}
+
+static int cmd_phy(const struct shell *sh, size_t argc, char **argv)
+{
+	struct link_phy_stats st;
+
+	link_phy_stats_get(&st);
+	shell_print(sh, "connects %u (Coded %u), PHY changes %u", st.connects,
+		    st.coded_connects, st.changes);
+	bt_conn_foreach(BT_CONN_TYPE_LE, phy_print, (void *)sh);
+
+	return 0;
+}
+
+static int cmd_dedup(const struct shell *sh, size_t argc, char **argv)
+{
+	struct dedup_stats st;
+
+	dedup_stats_get(&st);
+	shell_print(sh, "accepted %u, duplicates %u, reordered %u, gaps %u, "
+		    "peers evicted %u", st.accepted, st.duplicates,
+		    st.reordered, st.gaps, st.evicted);
+
+	return 0;
+}
+
+static int cmd_category(const struct shell *sh, size_t argc, char **argv)
+{
+	unsigned long category;
+	char *end;
+	int ret;
+
+	category = strtoul(argv[1], &end, 0);
+	if (*end || category >= FLEET_CATEGORIES) {
+		shell_error(sh, "Invalid category %s, 0 to %d", argv[1],
+			    FLEET_CATEGORIES - 1);
+		return -EINVAL;
+	}
+
+	ret = fleet_category_set(category);
+	if (ret < 0) {
+		shell_error(sh, "Category broadcast failed (err %d)", ret);
+		return ret;
+	}
+
+	shell_print(sh, "Category %lu queued to %d checkpoints", category, ret);
+
+	return 0;
+}
+
+static int cmd_scan(const struct shell *sh, size_t argc, char **argv)
+{
+	struct scan_stats st;
+
+	if (argc > 1) {
+		scan_expected_set(strtoul(argv[1], NULL, 0));
+	}
+
+	scan_stats_get(&st);
+	shell_print(sh, "%s, %u/%u checkpoints connected, starts %u failed %u, "
+		    "connects %u", scan_mode_str(st.mode), st.connected,
+		    st.expected, st.starts, st.start_errors, st.connects);
+
+	return 0;
+}
+
+static int cmd_trace_start(const struct shell *sh, size_t argc, char **argv)
+{
+	trace_enable(true);
+	shell_print(sh, "Tracing, %u of %u entries used", trace_count(),
+		    TRACE_ENTRIES);
+
+	return 0;
+}
+
+static int cmd_trace_stop(const struct shell *sh, size_t argc, char **argv)
+{
+	trace_enable(false);
+
+	return 0;
+}
+
+static int cmd_trace_clear(const struct shell *sh, size_t argc, char **argv)
+{
+	trace_clear();
+
+	return 0;
+}
+
+// One hex line per entry between begin and end markers, parsed by
+// tools/trace_replay.py from a console capture.
+static int cmd_trace_dump(const struct shell *sh, size_t argc, char **argv)
+{
+	struct trace_entry e;
+	char hex[2 * sizeof(e) + 1];
+	uint32_t i;
+
+	shell_print(sh, "trace-begin %u %u", TRACE_VERSION, trace_count());
+	for (i = 0; trace_get(i, &e); i++) {
+		bin2hex((const uint8_t *)&e, sizeof(e), hex, sizeof(hex));
+		shell_print(sh, "trace %s", hex);
+	}
+	shell_print(sh, "trace-end %u", i);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(trace_cmds,
+	SHELL_CMD(start, NULL, "Start recording taps", cmd_trace_start),
+	SHELL_CMD(stop, NULL, "Stop recording", cmd_trace_stop),
+	SHELL_CMD(clear, NULL, "Drop the recorded taps", cmd_trace_clear),
+	SHELL_CMD(dump, NULL, "Print the recorded taps as hex", cmd_trace_dump),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_latency(const struct shell *sh, size_t argc, char **argv)
+{
+	latency_report(true);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(checkpoint_cmds,
+	SHELL_CMD(threads, NULL,
+		  "Thread run time, CPU share and stack high-water mark",
+		  cmd_threads),
+	SHELL_CMD(bufs, NULL, "Buffer pool occupancy", cmd_bufs),
+	SHELL_CMD(stats, NULL, "Event and acknowledgement counters", cmd_stats),
+	SHELL_CMD(dedup, NULL, "Tap record deduplication counters", cmd_dedup),
+	SHELL_CMD(energy, NULL, "CPU and estimated radio active time",
+		  cmd_energy),
+	SHELL_CMD(usb, NULL, "USB console channel counters", cmd_usb),
+	SHELL_CMD(phy, NULL, "PHY and RSSI of every checkpoint link", cmd_phy),
+	SHELL_CMD_ARG(category, NULL,
+		      "Set the URL category of every connected checkpoint",
+		      cmd_category, 2, 0),
+	SHELL_CMD_ARG(scan, NULL,
+		      "Scan scheduler state, optionally set the expected "
+		      "checkpoint count: scan [count]", cmd_scan, 1, 1),
+	SHELL_CMD(trace, &trace_cmds, "Tap trace recording", NULL),
+	SHELL_CMD(latency, NULL, "Tap latency percentiles per checkpoint",
+		  cmd_latency),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(checkpoint, &checkpoint_cmds, "NFC checkpoint diagnostics",
+		   NULL);
@@ -0,0 +1,141 @@
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <string.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+#include "energy.h"
+#include "central_stats.h"
+#include "scan.h"
+#include "host_link.h"
+
+// Radio time of a connection event with an empty packet exchange and the
+// ramp-up around it.
+#define ENERGY_CONN_EVENT_US 400
+
+// Period of the energy line on the console, for runs without a shell.
+#define ENERGY_REPORT_INTERVAL K_MINUTES(5)
+
+// Connection interval of a link since it last changed.
+struct energy_link {
+	int64_t since;
+	uint16_t interval; // 1.25 ms units, 0 when not connected.
+};
+
+static struct energy_link links[CONFIG_BT_MAX_CONN];
+static uint64_t conn_events;
+static K_MUTEX_DEFINE(energy_lock);
+
+static uint64_t link_events(const struct energy_link *link, int64_t now)
+{
+	if (!link->interval) {
+		return 0;
+	}
+
+	return (now - link->since) * 4 / (link->interval * 5);
+}
+
+static void link_set(struct bt_conn *conn, uint16_t interval)
+{
+	struct energy_link *link = &links[bt_conn_index(conn)];
+	int64_t now = k_uptime_get();
+
+	k_mutex_lock(&energy_lock, K_FOREVER);
+	conn_events += link_events(link, now);
+	link->since = now;
+	link->interval = interval;
+	k_mutex_unlock(&energy_lock);
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct bt_conn_info info;
+
+	if (err || bt_conn_get_info(conn, &info)) {
+		return;
+	}
+
+	link_set(conn, info.le.interval);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	link_set(conn, 0);
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	link_set(conn, interval);
+}
+
+BT_CONN_CB_DEFINE(energy_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+};
+
+static void idle_cycles(const struct k_thread *cthread, void *user_data)
+{
+	struct k_thread *thread = (struct k_thread *)cthread;
+	const char *name = k_thread_name_get(thread);
+	k_thread_runtime_stats_t rt;
+	uint64_t *idle = user_data;
+
+	if (name && !strcmp(name, "idle") &&
+	    k_thread_runtime_stats_get(thread, &rt) == 0) {
+		*idle += rt.execution_cycles;
+	}
+}
+
+void energy_stats_get(struct energy_stats *out)
+{
+	k_thread_runtime_stats_t all;
+	struct central_stats cst;
+	struct scan_stats sst;
+	uint64_t idle = 0;
+	uint64_t events;
+	int64_t now = k_uptime_get();
+
+	memset(out, 0, sizeof(*out));
+	out->uptime_ms = now;
+
+	if (k_thread_runtime_stats_all_get(&all) == 0) {
+		k_thread_foreach_unlocked(idle_cycles, &idle);
+		out->cpu_ms = k_cyc_to_ms_floor64(all.execution_cycles - idle);
+	}
+
+	scan_stats_get(&sst);
+	out->scan_ms = sst.listen_ms;
+
+	k_mutex_lock(&energy_lock, K_FOREVER);
+	events = conn_events;
+	for (int i = 0; i < ARRAY_SIZE(links); i++) {
+		events += link_events(&links[i], now);
+	}
+	k_mutex_unlock(&energy_lock);
+	out->conn_events = events;
+	out->conn_ms = events * ENERGY_CONN_EVENT_US / 1000;
+
+	central_stats_get(&cst);
+	out->notifications = cst.notifications + cst.journal_records +
+			     cst.relayed;
+}
+
+static void report_handler(struct k_work *work)
+{
+	struct energy_stats st;
+
+	energy_stats_get(&st);
+	host_link_printf(HOST_CHANNEL_STATS, ENERGY_FMT "\n", ENERGY_ARGS(st));
+
+	k_work_reschedule(k_work_delayable_from_work(work),
+			  ENERGY_REPORT_INTERVAL);
+}
+
+static K_WORK_DELAYABLE_DEFINE(report_work, report_handler);
+
+void energy_init(void)
+{
+	k_work_schedule(&report_work, ENERGY_REPORT_INTERVAL);
+}
@@ -0,0 +1,33 @@
+#ifndef ENERGY_H_
+#define ENERGY_H_
+
+#include <zephyr/types.h>
+
+// Energy accounting of the central.
+//
+// The open source controller has no radio activity hook, so radio time is
+// derived from what the host schedules: the scan windows actually used,
+// and one connection event per interval on every link at a nominal
+// event length.
+
+struct energy_stats {
+	uint32_t uptime_ms;
+	uint32_t cpu_ms;        // Time outside the idle thread.
+	uint32_t scan_ms;       // Radio time in scan windows.
+	uint32_t conn_events;   // Connection events, from the intervals.
+	uint32_t conn_ms;       // Their radio time at ENERGY_CONN_EVENT_US.
+	uint32_t notifications; // Notifications received.
+};
+
+// Starts the periodic energy line on the console.
+void energy_init(void);
+
+void energy_stats_get(struct energy_stats *stats);
+
+// One "energy key=value ..." line, parsed by Projects/tools/battery_life.py.
+#define ENERGY_FMT "energy uptime_ms=%u cpu_ms=%u scan_ms=%u " \
+	"conn_events=%u conn_ms=%u notifications=%u"
+#define ENERGY_ARGS(_st) (_st).uptime_ms, (_st).cpu_ms, (_st).scan_ms, \
+	(_st).conn_events, (_st).conn_ms, (_st).notifications
+
+#endif // ENERGY_H_
@@ -0,0 +1,128 @@
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <sys/atomic.h>
+#include <errno.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+
+#include "fleet.h"
+
+static uint16_t control_handle[CONFIG_BT_MAX_CONN];
+
+// Completion tracking of the last broadcast. A write without response
+// still queued at disconnection never completes, so every connection
+// holds its own bit, released by the completion or the disconnection.
+static atomic_t pending;
+static ATOMIC_DEFINE(pending_conns, CONFIG_BT_MAX_CONN);
+static atomic_t generation;
+static uint32_t started;
+static uint8_t sent_category;
+
+void fleet_control_handle_set(struct bt_conn *conn, uint16_t handle)
+{
+	control_handle[bt_conn_index(conn)] = handle;
+}
+
+static int sent_count;
+
+static void pending_put(void)
+{
+	if (atomic_dec(&pending) == 1 && sent_count) {
+		printk("Category %u sent to %d checkpoints in %u ms\n",
+		       sent_category, sent_count, k_uptime_get_32() - started);
+	}
+}
+
+static void conn_release(struct bt_conn *conn)
+{
+	if (atomic_test_and_clear_bit(pending_conns, bt_conn_index(conn))) {
+		pending_put();
+	}
+}
+
+static void write_done(struct bt_conn *conn, void *user_data)
+{
+	// Late completion of an earlier broadcast, already released.
+	if ((atomic_val_t)(uintptr_t)user_data != atomic_get(&generation)) {
+		return;
+	}
+
+	conn_release(conn);
+}
+
+struct broadcast_ctx {
+	uint8_t category;
+	int sent;
+	int err;
+};
+
+static void conn_write(struct bt_conn *conn, void *user_data)
+{
+	struct broadcast_ctx *ctx = user_data;
+	uint16_t handle = control_handle[bt_conn_index(conn)];
+	int err;
+
+	if (!handle) {
+		return;
+	}
+
+	atomic_inc(&pending);
+	atomic_set_bit(pending_conns, bt_conn_index(conn));
+	err = bt_gatt_write_without_response_cb(conn, handle, &ctx->category,
+						sizeof(ctx->category), false,
+						write_done,
+						(void *)(uintptr_t)atomic_get(&generation));
+	if (err) {
+		atomic_clear_bit(pending_conns, bt_conn_index(conn));
+		atomic_dec(&pending);
+		ctx->err = err;
+		return;
+	}
+
+	ctx->sent++;
+}
+
+int fleet_category_set(uint8_t category)
+{
+	struct broadcast_ctx ctx = {
+		.category = category,
+	};
+
+	if (category >= FLEET_CATEGORIES) {
+		return -EINVAL;
+	}
+
+	if (atomic_get(&pending)) {
+		return -EBUSY;
+	}
+
+	atomic_inc(&generation);
+	// Held until every write is queued, so early completions do not
+	// report the broadcast as done.
+	atomic_set(&pending, 1);
+	started = k_uptime_get_32();
+	sent_category = category;
+	sent_count = 0;
+	bt_conn_foreach(BT_CONN_TYPE_LE, conn_write, &ctx);
+	sent_count = ctx.sent;
+	pending_put();
+
+	if (!ctx.sent && ctx.err) {
+		return ctx.err;
+	}
+
+	return ctx.sent;
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	ARG_UNUSED(reason);
+
+	control_handle[bt_conn_index(conn)] = 0U;
+	conn_release(conn);
+}
+
+BT_CONN_CB_DEFINE(fleet_conn_callbacks) = {
+	.disconnected = disconnected,
+};
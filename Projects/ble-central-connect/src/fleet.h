@@ -0,0 +1,22 @@
+#ifndef FLEET_H_
+#define FLEET_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/conn.h>
+
+// Commands sent to every connected checkpoint at once.
+
+// Categories a checkpoint accepts, 0 to FLEET_CATEGORIES - 1.
+#define FLEET_CATEGORIES 4
+
+// Category characteristic handle of a checkpoint, 0 if it has none.
+void fleet_control_handle_set(struct bt_conn *conn, uint16_t handle);
+
+// Queues a category write to every checkpoint without waiting for the
+// previous one, so all links transmit in the same connection events.
+// Returns the number of checkpoints written to, or a negative error:
+// -EINVAL for a category checkpoints reject, -EBUSY while the previous
+// broadcast has writes in flight.
+int fleet_category_set(uint8_t category);
+
+#endif // FLEET_H_
@@ -0,0 +1,285 @@
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <sys/atomic.h>
+#include <string.h>
+#include <device.h>
+#include <drivers/uart.h>
+#include <usb/usb_device.h>
+
+#include "host_link.h"
+
+// Ring sizes in lines, powers of two.
+#define EVENTS_SLOTS 32
+#define STATS_SLOTS 16
+#define LOGS_SLOTS 16
+
+// Console hooks of lib/os/printk.c, not in a public header.
+extern void __printk_hook_install(int (*fn)(int));
+extern void *__printk_get_hook(void);
+
+// One line, 160 bytes with its header. A slot is free for the producer
+// claiming position pos when seq == pos, and ready for the consumer when
+// seq == pos + 1.
+struct line_slot {
+	atomic_t seq;
+	uint16_t len;
+	char data[HOST_LINK_LINE_MAX];
+};
+
+struct channel {
+	const struct device *dev;
+	const char *name;
+	struct line_slot *slots;
+	uint32_t mask;
+	bool ready;
+	atomic_t head;   // Next position producers claim.
+	uint32_t tail;   // Next position sent, interrupt only.
+	uint16_t offset; // Bytes of the tail slot already sent.
+	atomic_t lines;
+	atomic_t bytes;
+	atomic_t dropped;
+	atomic_t fallback;
+};
+
+static struct line_slot events_slots[EVENTS_SLOTS];
+static struct line_slot stats_slots[STATS_SLOTS];
+static struct line_slot logs_slots[LOGS_SLOTS];
+
+#define CHANNEL(_node, _name, _slots) { \
+	.dev = DEVICE_DT_GET(DT_NODELABEL(_node)), \
+	.name = _name, \
+	.slots = _slots, \
+	.mask = ARRAY_SIZE(_slots) - 1, \
+}
+
+static struct channel channels[HOST_CHANNEL_COUNT] = {
+	[HOST_CHANNEL_EVENTS] = CHANNEL(cdc_acm_events, "events", events_slots),
+	[HOST_CHANNEL_STATS] = CHANNEL(cdc_acm_stats, "stats", stats_slots),
+	[HOST_CHANNEL_LOGS] = CHANNEL(cdc_acm_logs, "logs", logs_slots),
+};
+
+// The UART console, where closed channels print.
+static int (*uart_out)(int c);
+
+// printk() line being assembled for the logs channel.
+static char log_line[HOST_LINK_LINE_MAX];
+static size_t log_len;
+
+static bool channel_open(struct channel *ch)
+{
+	uint32_t dtr = 0;
+
+	return ch->ready &&
+	       uart_line_ctrl_get(ch->dev, UART_LINE_CTRL_DTR, &dtr) == 0 &&
+	       dtr;
+}
+
+// Multi-producer, single consumer: producers race for a position with a
+// compare and swap only, and never wait for the consumer.
+static bool channel_put(struct channel *ch, const char *line, size_t len)
+{
+	struct line_slot *slot;
+	atomic_val_t pos = atomic_get(&ch->head);
+
+	for (;;) {
+		int32_t diff;
+
+		slot = &ch->slots[pos & ch->mask];
+		diff = (int32_t)((uint32_t)atomic_get(&slot->seq) - (uint32_t)pos);
+		if (diff < 0) {
+			// The slot still holds a line from the previous lap.
+			atomic_inc(&ch->dropped);
+			return false;
+		}
+
+		if (diff == 0 && atomic_cas(&ch->head, pos, pos + 1)) {
+			break;
+		}
+
+		pos = atomic_get(&ch->head);
+	}
+
+	len = MIN(len, sizeof(slot->data));
+	memcpy(slot->data, line, len);
+	slot->len = len;
+	atomic_set(&slot->seq, pos + 1);
+	atomic_inc(&ch->lines);
+
+	uart_irq_tx_enable(ch->dev);
+
+	return true;
+}
+
+static void channel_drain(struct channel *ch)
+{
+	for (;;) {
+		struct line_slot *slot = &ch->slots[ch->tail & ch->mask];
+		int sent;
+
+		if ((uint32_t)atomic_get(&slot->seq) != ch->tail + 1) {
+			uart_irq_tx_disable(ch->dev);
+			// A producer can commit between the check and the disable,
+			// its enable must not be lost.
+			if ((uint32_t)atomic_get(&slot->seq) == ch->tail + 1) {
+				uart_irq_tx_enable(ch->dev);
+			}
+			return;
+		}
+
+		sent = uart_fifo_fill(ch->dev, slot->data + ch->offset,
+				      slot->len - ch->offset);
+		if (sent <= 0) {
+			return;
+		}
+
+		atomic_add(&ch->bytes, sent);
+		ch->offset += sent;
+		if (ch->offset < slot->len) {
+			return;
+		}
+
+		ch->offset = 0;
+		atomic_set(&slot->seq, ch->tail + ch->mask + 1);
+		ch->tail++;
+	}
+}
+
+static void channel_isr(const struct device *dev, void *user_data)
+{
+	struct channel *ch = user_data;
+	uint8_t discard[16];
+
+	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+		if (uart_irq_rx_ready(dev)) {
+			// Nothing is read from the host on these ports.
+			(void)uart_fifo_read(dev, discard, sizeof(discard));
+		}
+
+		if (uart_irq_tx_ready(dev)) {
+			channel_drain(ch);
+		}
+	}
+}
+
+static void uart_print(const char *line, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		uart_out(line[i]);
+	}
+}
+
+void host_link_printf(enum host_channel id, const char *fmt, ...)
+{
+	struct channel *ch = &channels[id];
+	char line[HOST_LINK_LINE_MAX];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	if (!uart_out) {
+		// Not initialized yet, the console is still printk() itself.
+		vprintk(fmt, ap);
+		va_end(ap);
+		return;
+	}
+	len = vsnprintk(line, sizeof(line) - 1, fmt, ap);
+	va_end(ap);
+
+	if (len > (int)sizeof(line) - 2) {
+		// Truncated, keep the line ending.
+		len = sizeof(line) - 2;
+		line[len - 1] = '\n';
+	}
+
+	if (!channel_open(ch)) {
+		atomic_inc(&ch->fallback);
+		uart_print(line, len);
+		return;
+	}
+
+	// Terminals on the host expect CR LF.
+	if (len && line[len - 1] == '\n') {
+		line[len - 1] = '\r';
+		line[len++] = '\n';
+	}
+	(void)channel_put(ch, line, len);
+}
+
+static int log_out(int c)
+{
+	struct channel *ch = &channels[HOST_CHANNEL_LOGS];
+	unsigned int key;
+
+	if (!channel_open(ch)) {
+		if (c == '\n') {
+			atomic_inc(&ch->fallback);
+		}
+		return uart_out(c);
+	}
+
+	// printk() runs in any context. Interrupts are locked for the append
+	// only, handing the line to the ring does not wait either.
+	key = irq_lock();
+	if (c == '\n' && log_len < sizeof(log_line) - 1) {
+		log_line[log_len++] = '\r';
+	}
+	log_line[log_len++] = c;
+	if (c == '\n' || log_len == sizeof(log_line)) {
+		(void)channel_put(ch, log_line, log_len);
+		log_len = 0;
+	}
+	irq_unlock(key);
+
+	return c;
+}
+
+int host_link_init(void)
+{
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(channels); i++) {
+		struct channel *ch = &channels[i];
+
+		for (uint32_t pos = 0; pos <= ch->mask; pos++) {
+			atomic_set(&ch->slots[pos].seq, pos);
+		}
+
+		if (!device_is_ready(ch->dev)) {
+			printk("USB %s port not ready\n", ch->name);
+			continue;
+		}
+
+		uart_irq_callback_user_data_set(ch->dev, channel_isr, ch);
+		ch->ready = true;
+	}
+
+	err = usb_enable(NULL);
+	if (err && err != -EALREADY) {
+		printk("USB enable failed (err %d), console on UART only\n",
+		       err);
+		return err;
+	}
+
+	uart_out = __printk_get_hook();
+	__printk_hook_install(log_out);
+
+	return 0;
+}
+
+void host_link_stats_get(enum host_channel id, struct host_link_stats *out)
+{
+	struct channel *ch = &channels[id];
+
+	out->open = channel_open(ch);
+	out->lines = atomic_get(&ch->lines);
+	out->bytes = atomic_get(&ch->bytes);
+	out->dropped = atomic_get(&ch->dropped);
+	out->fallback = atomic_get(&ch->fallback);
+	out->used = (uint32_t)atomic_get(&ch->head) - ch->tail;
+	out->slots = ch->mask + 1;
+}
+
+const char *host_channel_str(enum host_channel id)
+{
+	return channels[id].name;
+}
@@ -0,0 +1,45 @@
+#ifndef HOST_LINK_H_
+#define HOST_LINK_H_
+
+#include <zephyr/types.h>
+
+// Console output to the host over native USB.
+//
+// Each channel is a CDC ACM port of its own, fed from a lock-free ring of
+// line slots that the port drains from its interrupt. Producers never wait:
+// a line that finds its ring full is dropped and counted, so a host that
+// stops reading the logs port cannot hold up taps on the events port.
+// Until the host opens a port (asserts DTR), its lines go to the UART
+// console as before.
+
+enum host_channel {
+	HOST_CHANNEL_EVENTS, // Tap lines, parsed by the host tools.
+	HOST_CHANNEL_STATS,  // Periodic latency and energy lines.
+	HOST_CHANNEL_LOGS,   // Everything else printed with printk().
+	HOST_CHANNEL_COUNT,
+};
+
+// Longest line carried in one slot, longer lines are truncated.
+#define HOST_LINK_LINE_MAX 154
+
+struct host_link_stats {
+	bool open;         // Host has the port open.
+	uint32_t lines;    // Lines queued on the USB port.
+	uint32_t bytes;    // Bytes handed to the USB port.
+	uint32_t dropped;  // Lines dropped on a full ring.
+	uint32_t fallback; // Lines printed on the UART instead.
+	uint32_t used;     // Slots waiting to be sent.
+	uint32_t slots;
+};
+
+// Enables the USB device and routes printk() through the logs channel.
+int host_link_init(void);
+
+// Prints one line on a channel, or on the UART while the channel is closed.
+void host_link_printf(enum host_channel ch, const char *fmt, ...);
+
+void host_link_stats_get(enum host_channel ch, struct host_link_stats *stats);
+
+const char *host_channel_str(enum host_channel ch);
+
+#endif // HOST_LINK_H_
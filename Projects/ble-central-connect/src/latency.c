@@ -0,0 +1,160 @@
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <sys/util.h>
+#include <bluetooth/bluetooth.h>
+
+#include "latency.h"
+#include "host_link.h"
+
+#define LATENCY_PEERS 8
+
+// Upper bounds of the histogram buckets in milliseconds. Finer where the
+// door-opening SLO sits, coarser for replayed taps.
+static const uint16_t bucket_ms[] = {
+	2, 4, 6, 8, 10, 15, 20, 25, 30, 40, 50, 60, 80, 100, 125, 150,
+	200, 250, 300, 400, 500, 750, 1000, 1500, 2000, 3000, 5000, 10000,
+};
+
+struct latency_hist {
+	bt_addr_le_t peer;
+	bool used;
+	uint32_t count;
+	uint32_t reported;
+	uint32_t max_ms;
+	uint64_t sum_ms;
+	// Last bucket counts samples above the largest bound.
+	uint32_t buckets[ARRAY_SIZE(bucket_ms) + 1];
+};
+
+static struct latency_hist hists[LATENCY_PEERS];
+
+static struct latency_hist *hist_get(const bt_addr_le_t *peer)
+{
+	struct latency_hist *free_hist = NULL;
+
+	for (int i = 0; i < ARRAY_SIZE(hists); i++) {
+		if (hists[i].used && !bt_addr_le_cmp(&hists[i].peer, peer)) {
+			return &hists[i];
+		}
+		if (!hists[i].used && !free_hist) {
+			free_hist = &hists[i];
+		}
+	}
+
+	if (free_hist) {
+		memset(free_hist, 0, sizeof(*free_hist));
+		bt_addr_le_copy(&free_hist->peer, peer);
+		free_hist->used = true;
+	}
+
+	return free_hist;
+}
+
+void latency_record(const bt_addr_le_t *peer, uint32_t latency_ms)
+{
+	struct latency_hist *hist = hist_get(peer);
+	int i;
+
+	if (!hist) {
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(bucket_ms); i++) {
+		if (latency_ms <= bucket_ms[i]) {
+			break;
+		}
+	}
+
+	hist->buckets[i]++;
+	hist->count++;
+	hist->sum_ms += latency_ms;
+	hist->max_ms = MAX(hist->max_ms, latency_ms);
+}
+
+// Upper bound of the bucket holding the given percentile, 0 if the
+// percentile lies above the largest bucket.
+static uint32_t percentile(const struct latency_hist *hist, uint32_t pct)
+{
+	uint32_t rank = (hist->count * pct + 99) / 100;
+	uint32_t seen = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(bucket_ms); i++) {
+		seen += hist->buckets[i];
+		if (seen >= rank) {
+			return bucket_ms[i];
+		}
+	}
+
+	return 0;
+}
+
+void latency_report(bool force)
+{
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	for (int i = 0; i < ARRAY_SIZE(hists); i++) {
+		struct latency_hist *hist = &hists[i];
+
+		if (!hist->used || (hist->count == hist->reported && !force)) {
+			continue;
+		}
+
+		hist->reported = hist->count;
+		bt_addr_le_to_str(&hist->peer, addr, sizeof(addr));
+		// A percentile of 0 means "above the largest bucket".
+		host_link_printf(HOST_CHANNEL_STATS,
+				 "Latency %s: n=%u p50<=%u p95<=%u p99<=%u max=%u ms\n",
+				 addr, hist->count, percentile(hist, 50),
+				 percentile(hist, 95), percentile(hist, 99),
+				 hist->max_ms);
+	}
+}
+
+// Bucket counts per line, keeps the line within HOST_LINK_LINE_MAX.
+#define METRICS_BUCKETS_PER_LINE 6
+
+void latency_metrics(void)
+{
+	char addr[BT_ADDR_STR_LEN];
+	char line[HOST_LINK_LINE_MAX];
+
+	for (int i = 0; i < ARRAY_SIZE(hists); i++) {
+		struct latency_hist *hist = &hists[i];
+		int len = 0;
+		int n = 0;
+
+		if (!hist->used) {
+			continue;
+		}
+
+		bt_addr_to_str(&hist->peer.a, addr, sizeof(addr));
+		host_link_printf(HOST_CHANNEL_STATS,
+				 "metrics latency %s count=%u sum_ms=%llu max_ms=%u\n",
+				 addr, hist->count, hist->sum_ms, hist->max_ms);
+
+		for (int b = 0; b < ARRAY_SIZE(hist->buckets); b++) {
+			if (!hist->buckets[b]) {
+				continue;
+			}
+			if (b < ARRAY_SIZE(bucket_ms)) {
+				len += snprintk(line + len, sizeof(line) - len,
+						" %u=%u", bucket_ms[b],
+						hist->buckets[b]);
+			} else {
+				len += snprintk(line + len, sizeof(line) - len,
+						" inf=%u", hist->buckets[b]);
+			}
+			if (++n == METRICS_BUCKETS_PER_LINE) {
+				host_link_printf(HOST_CHANNEL_STATS,
+						 "metrics latency_bucket %s%s\n",
+						 addr, line);
+				len = n = 0;
+			}
+		}
+		if (n) {
+			host_link_printf(HOST_CHANNEL_STATS,
+					 "metrics latency_bucket %s%s\n",
+					 addr, line);
+		}
+	}
+}
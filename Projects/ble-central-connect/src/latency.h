@@ -0,0 +1,20 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/addr.h>
+
+// Tap-to-receive latency histograms, one per checkpoint.
+
+// Records the latency of one tap received from a checkpoint.
+void latency_record(const bt_addr_le_t *peer, uint32_t latency_ms);
+
+// Prints p50/p95/p99 for every checkpoint with new samples, or for every
+// checkpoint seen if force is set.
+void latency_report(bool force);
+
+// Prints the histogram of every checkpoint seen as "metrics latency" lines,
+// the non-empty buckets as <upper bound ms>=<count>, "inf" above the last.
+void latency_metrics(void);
+
+#endif // LATENCY_H_
@@ -0,0 +1,132 @@
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <errno.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/hci.h>
+
+#include "link_phy.h"
+
+static struct link_phy_info links[CONFIG_BT_MAX_CONN];
+static struct link_phy_stats stats;
+static K_MUTEX_DEFINE(phy_lock);
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct link_phy_info *link = &links[bt_conn_index(conn)];
+	struct bt_conn_info info;
+
+	if (err || bt_conn_get_info(conn, &info)) {
+		return;
+	}
+
+	k_mutex_lock(&phy_lock, K_FOREVER);
+	link->tx_phy = info.le.phy->tx_phy;
+	link->rx_phy = info.le.phy->rx_phy;
+	link->changes = 0;
+	stats.connects++;
+	if (link->rx_phy == BT_GAP_LE_PHY_CODED) {
+		stats.coded_connects++;
+	}
+	k_mutex_unlock(&phy_lock);
+
+	printk("Link on the %s PHY\n", link_phy_str(info.le.phy->rx_phy));
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct link_phy_info *link = &links[bt_conn_index(conn)];
+
+	k_mutex_lock(&phy_lock, K_FOREVER);
+	link->tx_phy = 0;
+	link->rx_phy = 0;
+	k_mutex_unlock(&phy_lock);
+}
+
+static void le_phy_updated(struct bt_conn *conn,
+			   struct bt_conn_le_phy_info *param)
+{
+	struct link_phy_info *link = &links[bt_conn_index(conn)];
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	k_mutex_lock(&phy_lock, K_FOREVER);
+	link->tx_phy = param->tx_phy;
+	link->rx_phy = param->rx_phy;
+	link->changes++;
+	stats.changes++;
+	k_mutex_unlock(&phy_lock);
+
+	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	printk("PHY of %s now %s\n", addr, link_phy_str(param->rx_phy));
+}
+
+BT_CONN_CB_DEFINE(link_phy_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_phy_updated = le_phy_updated,
+};
+
+int link_phy_get(struct bt_conn *conn, struct link_phy_info *info)
+{
+	k_mutex_lock(&phy_lock, K_FOREVER);
+	*info = links[bt_conn_index(conn)];
+	k_mutex_unlock(&phy_lock);
+
+	return info->tx_phy ? 0 : -ENOTCONN;
+}
+
+int link_phy_rssi(struct bt_conn *conn, int8_t *rssi)
+{
+	struct bt_hci_cp_read_rssi *cp;
+	struct bt_hci_rp_read_rssi *rp;
+	struct net_buf *buf;
+	struct net_buf *rsp = NULL;
+	uint16_t handle;
+	int err;
+
+	err = bt_hci_get_conn_handle(conn, &handle);
+	if (err) {
+		return err;
+	}
+
+	buf = bt_hci_cmd_create(BT_HCI_OP_READ_RSSI, sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle = sys_cpu_to_le16(handle);
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_RSSI, buf, &rsp);
+	if (err) {
+		return err;
+	}
+
+	rp = (void *)rsp->data;
+	*rssi = rp->rssi;
+	net_buf_unref(rsp);
+
+	return 0;
+}
+
+void link_phy_stats_get(struct link_phy_stats *out)
+{
+	k_mutex_lock(&phy_lock, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&phy_lock);
+}
+
+const char *link_phy_str(uint8_t phy)
+{
+	switch (phy) {
+	case BT_GAP_LE_PHY_1M:
+		return "1M";
+	case BT_GAP_LE_PHY_2M:
+		return "2M";
+	case BT_GAP_LE_PHY_CODED:
+		return "Coded";
+	default:
+		return "none";
+	}
+}
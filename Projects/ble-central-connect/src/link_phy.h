@@ -0,0 +1,35 @@
+#ifndef LINK_PHY_H_
+#define LINK_PHY_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/conn.h>
+
+// PHY of the checkpoint links.
+//
+// The checkpoints choose the PHY of their link from its RSSI and packet
+// error rate; the central scans and initiates on the Coded PHY as well, so
+// checkpoints at long range are found, and accepts whatever PHY they ask
+// for. This module only keeps track of the result.
+
+struct link_phy_info {
+	uint8_t tx_phy;   // BT_GAP_LE_PHY_*, 0 when not connected.
+	uint8_t rx_phy;
+	uint32_t changes; // PHY updates since the link came up.
+};
+
+struct link_phy_stats {
+	uint32_t connects;       // Links established.
+	uint32_t coded_connects; // Of which on the Coded PHY.
+	uint32_t changes;        // PHY updates on all links.
+};
+
+int link_phy_get(struct bt_conn *conn, struct link_phy_info *info);
+
+// Reads the RSSI of a link from the controller.
+int link_phy_rssi(struct bt_conn *conn, int8_t *rssi);
+
+void link_phy_stats_get(struct link_phy_stats *stats);
+
+const char *link_phy_str(uint8_t phy);
+
+#endif // LINK_PHY_H_
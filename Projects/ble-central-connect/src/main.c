@@ -13,25 +13,161 @@
 #include <bluetooth/gatt.h>
 #include <sys/byteorder.h>
 
+#include "latency.h"
+#include "central_stats.h"
+#include "tap_record.h"
+#include "dedup.h"
+#include "fleet.h"
+#include "scan.h"
+#include "trace.h"
+#include "energy.h"
+#include "host_link.h"
+#include "metrics.h"
+
 //#define LAB2_SERVICE_UUID BT_UUID_128_ENCODE(0x12345618,0xE47C,0x4EC8,0x9792,0x69FDF4923B4A)
 //#define LAB2_SERVICE_CHARACTERISTIC_UUID 0x000a
 #define ASSIGNMENT2_SERVICE_UUID BT_UUID_128_ENCODE(0xBDFC9792,0x8234,0x405E,0xAE02,0x35EF3274B299)
 #define ASSIGNMENT2_BUTTON1_CHARACTERISTIC_UUID 0x0001
+#define ASSIGNMENT2_JOURNAL_CHARACTERISTIC_UUID 0x0002
+#define ASSIGNMENT2_TIME_SYNC_CHARACTERISTIC_UUID 0x0003
+#define ASSIGNMENT2_CATEGORY_CHARACTERISTIC_UUID 0x0004
+#define ASSIGNMENT2_RELAY_CHARACTERISTIC_UUID 0x0005
+
+// Acknowledge the journal after this many records or this much idle time.
+#define JOURNAL_ACK_EVERY 16
+#define JOURNAL_ACK_DELAY K_MSEC(200)
 
-static void start_scan(void);
+// Period of the clock writes to the checkpoint and of the latency report.
+#define TIME_SYNC_INTERVAL K_SECONDS(5)
+#define LATENCY_REPORT_INTERVAL K_SECONDS(30)
 
-static struct bt_conn *default_conn;
 
 static struct bt_uuid* search_service_uuid = BT_UUID_DECLARE_128(ASSIGNMENT2_SERVICE_UUID);
 /*static struct bt_uuid* search_button1_uuid = BT_UUID_DECLARE_16(ASSIGNMENT2_BUTTON1_CHARACTERISTIC_UUID);
 static struct bt_uuid* search_button2_uuid = BT_UUID_DECLARE_16(ASSIGNMENT2_BUTTON2_CHARACTERISTIC_UUID);
 static struct bt_uuid* search_button3_uuid = BT_UUID_DECLARE_16(ASSIGNMENT2_BUTTON3_CHARACTERISTIC_UUID);
 static struct bt_uuid* search_button4_uuid = BT_UUID_DECLARE_16(ASSIGNMENT2_BUTTON4_CHARACTERISTIC_UUID);*/
-static struct bt_gatt_discover_params discover_params;
 //static struct bt_gatt_read_params read_params;
-static struct bt_uuid_16 uuid = BT_UUID_INIT_16(0);
 
-static struct bt_gatt_subscribe_params subscribe_param1;
+// Characteristics of the checkpoint service the central uses.
+enum checkpoint_char {
+	CHAR_TEXT,
+	CHAR_JOURNAL,
+	CHAR_TIME_SYNC,
+	CHAR_CATEGORY,
+	CHAR_RELAY,
+	CHAR_COUNT,
+};
+
+// Notification handlers are looked up by value handle relative to the start
+// of the service, which spans about half of this.
+#define DISPATCH_HANDLES 32
+
+// GATT client state of one checkpoint, indexed by bt_conn_index().
+struct checkpoint {
+	struct bt_conn *conn;
+	struct bt_gatt_discover_params discover_params;
+	uint16_t service_start;
+	uint16_t service_end;
+	// Characteristic a following CCC descriptor belongs to, or -1.
+	int8_t last_char;
+	uint16_t value_handle[CHAR_COUNT];
+	uint16_t ccc_handle[CHAR_COUNT];
+	struct bt_gatt_subscribe_params subscribe[CHAR_COUNT];
+	bt_gatt_notify_func_t dispatch[DISPATCH_HANDLES];
+	uint32_t journal_last_seq;
+	uint32_t journal_unacked;
+};
+
+static struct checkpoint checkpoints[CONFIG_BT_MAX_CONN];
+
+static uint32_t journal_last_seq;
+
+static struct central_stats stats;
+
+void central_stats_get(struct central_stats *out)
+{
+	*out = stats;
+	out->last_seq = journal_last_seq;
+	out->connected = 0;
+	for (int i = 0; i < ARRAY_SIZE(checkpoints); i++) {
+		if (checkpoints[i].conn) {
+			out->connected++;
+		}
+	}
+}
+
+static void journal_ack_handler(struct k_work *work)
+{
+	uint8_t buf[sizeof(uint32_t)];
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(checkpoints); i++) {
+		struct checkpoint *cp = &checkpoints[i];
+
+		if (!cp->conn || !cp->subscribe[CHAR_JOURNAL].value_handle ||
+		    !cp->journal_unacked) {
+			continue;
+		}
+
+		sys_put_le32(cp->journal_last_seq, buf);
+		err = bt_gatt_write_without_response(cp->conn,
+						     cp->value_handle[CHAR_JOURNAL],
+						     buf, sizeof(buf), false);
+		if (err) {
+			printk("Journal ack failed (err %d)\n", err);
+			stats.ack_failures++;
+			continue;
+		}
+
+		stats.journal_acks++;
+		cp->journal_unacked = 0;
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(journal_ack_work, journal_ack_handler);
+
+// Sends our uptime to the checkpoint so it can timestamp taps in our clock.
+static void time_sync_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	uint8_t buf[sizeof(uint32_t)];
+	bool any = false;
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(checkpoints); i++) {
+		struct checkpoint *cp = &checkpoints[i];
+
+		if (!cp->conn || !cp->value_handle[CHAR_TIME_SYNC]) {
+			continue;
+		}
+
+		any = true;
+		sys_put_le32(k_uptime_get_32(), buf);
+		err = bt_gatt_write_without_response(cp->conn,
+						     cp->value_handle[CHAR_TIME_SYNC],
+						     buf, sizeof(buf), false);
+		if (err) {
+			printk("Time sync write failed (err %d)\n", err);
+		} else {
+			stats.time_syncs++;
+		}
+	}
+
+	if (any) {
+		k_work_reschedule(dwork, TIME_SYNC_INTERVAL);
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(time_sync_work, time_sync_handler);
+
+static void latency_report_handler(struct k_work *work)
+{
+	latency_report(false);
+	k_work_reschedule(k_work_delayable_from_work(work), LATENCY_REPORT_INTERVAL);
+}
+
+static K_WORK_DELAYABLE_DEFINE(latency_report_work, latency_report_handler);
 
 // Callback after reading characteristic value.
 /*static uint8_t read_func(struct bt_conn *conn, uint8_t err,
@@ -68,74 +204,281 @@ static uint8_t notify_func_1(struct bt_conn *conn,
 		printk("ERROR: notify failed (err %d)\n", err);
 	}*/
 
-	//uint8_t *status = (uint8_t*) data;
-	//printk((int) data);
-	//printk("\n");
-	char status[512];
-	strncpy( status, (char*) data, length );
-	status[length] = '\0';
-	printk("NFC Activity: %s\n", status );
+	if (!data) {
+		params->value_handle = 0U;
+		return BT_GATT_ITER_STOP;
+	}
+
+	// Printed straight from the notification, it is not NUL terminated.
+	printk("NFC Activity: %.*s\n", length, (const char *)data);
+	stats.notifications++;
 
 	return BT_GATT_ITER_CONTINUE;
 }
 
-static uint8_t discover_func(struct bt_conn *conn,
-			     const struct bt_gatt_attr *attr,
-			     struct bt_gatt_discover_params *params)
+// Called by the deduplication stage once per record, in sequence order.
+static void tap_emit(const bt_addr_le_t *peer, const struct tap_record *rec)
+{
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	// Host tools parse this line, keep its format in sync with them.
+	bt_addr_le_to_str(peer, addr, sizeof(addr));
+	host_link_printf(HOST_CHANNEL_EVENTS,
+			 "Tap #%u from %s: category %u at %u ms\n",
+			 sys_le32_to_cpu(rec->seq), addr, rec->category,
+			 sys_le32_to_cpu(rec->timestamp));
+	trace_record(peer, rec);
+
+	if (rec->flags & TAP_RECORD_SYNCED) {
+		int32_t latency = (int32_t)(k_uptime_get_32() -
+					    sys_le32_to_cpu(rec->timestamp));
+
+		// The offset estimate can be a little ahead of the true one.
+		latency_record(peer, MAX(latency, 0));
+	}
+}
+
+// Records arrive in sequence order, acking the latest one trims everything
+// before it from the checkpoint's journal.
+static uint8_t notify_func_journal(struct bt_conn *conn,
+				   struct bt_gatt_subscribe_params *params,
+				   const void *data, uint16_t length)
+{
+	struct checkpoint *cp = &checkpoints[bt_conn_index(conn)];
+	const struct tap_record *rec = data;
+
+	if (!data) {
+		printk("Journal unsubscribed\n");
+		params->value_handle = 0U;
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (length != sizeof(*rec)) {
+		printk("Journal record malformed\n");
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	// Replays after a reconnect and overlapping checkpoints deliver the
+	// same record more than once, it is still acked below.
+	(void)dedup_submit(bt_conn_get_dst(conn), rec);
+
+	cp->journal_last_seq = sys_le32_to_cpu(rec->seq);
+	journal_last_seq = cp->journal_last_seq;
+	stats.journal_records++;
+	if (++cp->journal_unacked >= JOURNAL_ACK_EVERY) {
+		k_work_reschedule(&journal_ack_work, K_NO_WAIT);
+	} else {
+		k_work_reschedule(&journal_ack_work, JOURNAL_ACK_DELAY);
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+// Relayed taps carry their origin instead of the connected checkpoint, and
+// the time they spent in relays instead of a synchronized timestamp. That
+// age leaves out the queueing at the origin and the last notification, so
+// it is counted on its own rather than as a tap latency.
+static uint8_t notify_func_relay(struct bt_conn *conn,
+				 struct bt_gatt_subscribe_params *params,
+				 const void *data, uint16_t length)
+{
+	const struct relay_pdu *pdu = data;
+	struct tap_record rec;
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	if (!data) {
+		params->value_handle = 0U;
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (length != sizeof(*pdu)) {
+		printk("Relay PDU malformed\n");
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	bt_addr_le_to_str(&pdu->origin, addr, sizeof(addr));
+	printk("Relayed tap from %s: %u hops, %u ms in relays\n", addr,
+	       pdu->hops, sys_le16_to_cpu(pdu->age_ms));
+	stats.relayed++;
+	stats.relay_hops += pdu->hops;
+	stats.relay_age_ms += sys_le16_to_cpu(pdu->age_ms);
+	stats.relay_age_max_ms = MAX(stats.relay_age_max_ms,
+				     sys_le16_to_cpu(pdu->age_ms));
+
+	// Time of reception, not synchronized: kept out of the latency
+	// histograms.
+	rec.seq = pdu->seq;
+	rec.timestamp = sys_cpu_to_le32(k_uptime_get_32());
+	rec.category = pdu->category;
+	rec.flags = 0;
+	(void)dedup_submit(&pdu->origin, &rec);
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static const struct {
+	uint16_t uuid;
+	const char *name;
+	// Handler of the notifications, NULL when the central does not subscribe.
+	bt_gatt_notify_func_t notify;
+} checkpoint_chars[CHAR_COUNT] = {
+	[CHAR_TEXT] = { ASSIGNMENT2_BUTTON1_CHARACTERISTIC_UUID, "text",
+			notify_func_1 },
+	[CHAR_JOURNAL] = { ASSIGNMENT2_JOURNAL_CHARACTERISTIC_UUID, "journal",
+			   notify_func_journal },
+	[CHAR_TIME_SYNC] = { ASSIGNMENT2_TIME_SYNC_CHARACTERISTIC_UUID,
+			     "time sync", NULL },
+	[CHAR_CATEGORY] = { ASSIGNMENT2_CATEGORY_CHARACTERISTIC_UUID,
+			    "category", NULL },
+	[CHAR_RELAY] = { ASSIGNMENT2_RELAY_CHARACTERISTIC_UUID, "relay",
+			 notify_func_relay },
+};
+
+// All subscriptions share this callback, the value handle selects the
+// handler without walking the characteristics.
+static uint8_t notify_dispatch(struct bt_conn *conn,
+			       struct bt_gatt_subscribe_params *params,
+			       const void *data, uint16_t length)
+{
+	struct checkpoint *cp = &checkpoints[bt_conn_index(conn)];
+	uint16_t index = params->value_handle - cp->service_start;
+
+	if (params->value_handle >= cp->service_start &&
+	    index < DISPATCH_HANDLES && cp->dispatch[index]) {
+		return cp->dispatch[index](conn, params, data, length);
+	}
+
+	if (!data) {
+		params->value_handle = 0U;
+		return BT_GATT_ITER_STOP;
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+// Called once the attribute pass is over. The CCC writes are queued back to
+// back, they complete within a few connection events instead of each one
+// waiting for the discovery of the next characteristic.
+static void discover_done(struct bt_conn *conn, struct checkpoint *cp)
 {
 	int err;
 
+	if (cp->value_handle[CHAR_TIME_SYNC]) {
+		k_work_reschedule(&time_sync_work, K_NO_WAIT);
+	}
+
+	if (cp->value_handle[CHAR_CATEGORY]) {
+		fleet_control_handle_set(conn, cp->value_handle[CHAR_CATEGORY]);
+	}
+
+	for (int i = 0; i < CHAR_COUNT; i++) {
+		struct bt_gatt_subscribe_params *sub = &cp->subscribe[i];
+		uint16_t handle = cp->value_handle[i];
+
+		if (!checkpoint_chars[i].notify) {
+			continue;
+		}
+
+		if (!handle || !cp->ccc_handle[i] ||
+		    handle - cp->service_start >= DISPATCH_HANDLES) {
+			printk("No %s notifications on this checkpoint\n",
+			       checkpoint_chars[i].name);
+			continue;
+		}
+
+		cp->dispatch[handle - cp->service_start] = checkpoint_chars[i].notify;
+		sub->notify = notify_dispatch;
+		sub->value = BT_GATT_CCC_NOTIFY;
+		sub->value_handle = handle;
+		sub->ccc_handle = cp->ccc_handle[i];
+
+		err = bt_gatt_subscribe(conn, sub);
+		if (err) {
+			printk("Subscribe to %s failed (err %d)\n",
+			       checkpoint_chars[i].name, err);
+		}
+	}
+}
+
+// One pass over the service range records the value handle of every known
+// characteristic and the CCC descriptor that follows it.
+static uint8_t discover_attr_func(struct bt_conn *conn,
+				  const struct bt_gatt_attr *attr,
+				  struct bt_gatt_discover_params *params)
+{
+	struct checkpoint *cp = CONTAINER_OF(params, struct checkpoint,
+					     discover_params);
+	uint16_t uuid;
+
 	if (!attr) {
 		printk("Discover complete\n");
 		(void)memset(params, 0, sizeof(*params));
+		discover_done(conn, cp);
 		return BT_GATT_ITER_STOP;
 	}
 
-	if (bt_uuid_cmp(discover_params.uuid, BT_UUID_DECLARE_128(ASSIGNMENT2_SERVICE_UUID)) == 0) {
-		printk("Found service\n");
+	if (attr->uuid->type != BT_UUID_TYPE_16) {
+		return BT_GATT_ITER_CONTINUE;
+	}
 
-		memcpy(&uuid, BT_UUID_DECLARE_16(ASSIGNMENT2_BUTTON1_CHARACTERISTIC_UUID), sizeof(uuid));
-		discover_params.uuid = &uuid.uuid;
-		discover_params.start_handle = attr->handle+1;
-		discover_params.type = BT_GATT_DISCOVER_CHARACTERISTIC;
+	uuid = BT_UUID_16(attr->uuid)->val;
+	if (uuid == BT_UUID_GATT_CHRC_VAL) {
+		cp->last_char = -1;
+		return BT_GATT_ITER_CONTINUE;
+	}
 
-		err = bt_gatt_discover(conn, &discover_params);
-		if (err) {
-			printk("Discover failed (err %d)\n", err);
+	if (uuid == BT_UUID_GATT_CCC_VAL) {
+		if (cp->last_char >= 0) {
+			cp->ccc_handle[cp->last_char] = attr->handle;
 		}
+		return BT_GATT_ITER_CONTINUE;
+	}
 
-		return BT_GATT_ITER_STOP;
-	}	
+	for (int i = 0; i < CHAR_COUNT; i++) {
+		if (checkpoint_chars[i].uuid == uuid) {
+			printk("Found %s characteristic\n", checkpoint_chars[i].name);
+			cp->value_handle[i] = attr->handle;
+			cp->last_char = i;
+			break;
+		}
+	}
 
-		//check for characteristic uuid and choose the right callback function
-	if (bt_uuid_cmp(discover_params.uuid, BT_UUID_DECLARE_16(ASSIGNMENT2_BUTTON1_CHARACTERISTIC_UUID)) == 0){
-			printk("Found button 1 characteristic\n");
-			subscribe_param1.notify = notify_func_1;	
-			subscribe_param1.value = BT_GATT_CCC_NOTIFY;
-			subscribe_param1.ccc_handle = attr->handle+2;
-			subscribe_param1.value_handle = bt_gatt_attr_value_handle(attr);
+	return BT_GATT_ITER_CONTINUE;
+}
 
-			err = bt_gatt_subscribe(conn, &subscribe_param1);
-			if (err) {
-				printk("Subscribe failed (err %d)\n", err);
-			}
+static uint8_t discover_func(struct bt_conn *conn,
+			     const struct bt_gatt_attr *attr,
+			     struct bt_gatt_discover_params *params)
+{
+	struct checkpoint *cp = CONTAINER_OF(params, struct checkpoint,
+					     discover_params);
+	struct bt_gatt_service_val *service;
+	int err;
 
-			return BT_GATT_ITER_STOP;		
+	if (!attr) {
+		printk("Service not found\n");
+		(void)memset(params, 0, sizeof(*params));
+		return BT_GATT_ITER_STOP;
 	}
 
-		//notify_params.uuid = discover_params.uuid;
-		//notify_params.attr = attr;
-		//notify_params.single.handle = bt_gatt_attr_value_handle(attr);
-		//notify_params.single.offset = 0U;
-		
-		/*
-		err = bt_gatt_notify_cb(conn, &notify_params);
-		if (err) {
-			printk("Notif failed (err %d)\n", err);
-		}else {printk("Notif success\n");}
-		*/
+	printk("Found service\n");
+	service = attr->user_data;
+	cp->service_start = attr->handle + 1;
+	cp->service_end = service->end_handle;
+	cp->last_char = -1;
+	cp->journal_unacked = 0;
+
+	cp->discover_params.uuid = NULL;
+	cp->discover_params.func = discover_attr_func;
+	cp->discover_params.start_handle = cp->service_start;
+	cp->discover_params.end_handle = cp->service_end;
+	cp->discover_params.type = BT_GATT_DISCOVER_ATTRIBUTE;
+
+	err = bt_gatt_discover(conn, &cp->discover_params);
+	if (err) {
+		printk("Discover failed (err %d)\n", err);
+	}
 
-	printk("Ending GATT Service...");
 	return BT_GATT_ITER_STOP;
 }
 
@@ -184,54 +527,65 @@ static uint8_t discover_func(struct bt_conn *conn,
 
 static void connected(struct bt_conn *conn, uint8_t conn_err)
 {
+	struct checkpoint *cp = &checkpoints[bt_conn_index(conn)];
 	char addr[BT_ADDR_LE_STR_LEN];
 	int err;
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
+	if (cp->conn != conn) {
+		return;
+	}
+
 	if (conn_err) {
 		printk("Failed to connect to %s (%u)\n", addr, conn_err);
 
-		bt_conn_unref(default_conn);
-		default_conn = NULL;
+		bt_conn_unref(cp->conn);
+		cp->conn = NULL;
 
-		start_scan();
+		scan_update();
 		return;
 	}
 
 	printk("Connected: %s\n", addr);
+	scan_update();
 
-	if (conn == default_conn) {
-		discover_params.uuid = search_service_uuid;
-		discover_params.func = discover_func;
-		discover_params.start_handle = BT_ATT_FIRST_ATTTRIBUTE_HANDLE;
-		discover_params.end_handle = BT_ATT_LAST_ATTTRIBUTE_HANDLE;
-		discover_params.type = BT_GATT_DISCOVER_PRIMARY;
+	cp->discover_params.uuid = search_service_uuid;
+	cp->discover_params.func = discover_func;
+	cp->discover_params.start_handle = BT_ATT_FIRST_ATTTRIBUTE_HANDLE;
+	cp->discover_params.end_handle = BT_ATT_LAST_ATTTRIBUTE_HANDLE;
+	cp->discover_params.type = BT_GATT_DISCOVER_PRIMARY;
 
-		err = bt_gatt_discover(default_conn, &discover_params);
-		if (err) {
-			printk("Discover failed(err %d)\n", err);
-			return;
-		}
+	err = bt_gatt_discover(conn, &cp->discover_params);
+	if (err) {
+		printk("Discover failed(err %d)\n", err);
+		return;
 	}
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
+	struct checkpoint *cp = &checkpoints[bt_conn_index(conn)];
 	char addr[BT_ADDR_LE_STR_LEN];
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
 	printk("Disconnected: %s (reason 0x%02x)\n", addr, reason);
 
-	if (default_conn != conn) {
+	if (cp->conn != conn) {
 		return;
 	}
 
-	bt_conn_unref(default_conn);
-	default_conn = NULL;
+	(void)memset(cp->value_handle, 0, sizeof(cp->value_handle));
+	(void)memset(cp->ccc_handle, 0, sizeof(cp->ccc_handle));
+	(void)memset(cp->dispatch, 0, sizeof(cp->dispatch));
+	cp->subscribe[CHAR_JOURNAL].value_handle = 0U;
+	cp->journal_unacked = 0U;
+
+	bt_conn_unref(cp->conn);
+	cp->conn = NULL;
 
-	start_scan();
+	scan_update();
 }
 
 BT_CONN_CB_DEFINE(conn_callbacks) = {
@@ -239,6 +593,17 @@ BT_CONN_CB_DEFINE(conn_callbacks) = {
 	.disconnected = disconnected,
 };
 
+// Initiate on the Coded PHY as well when the controller supports it, the
+// checkpoint may only be reachable there.
+#if defined(CONFIG_BT_CTLR_PHY_CODED)
+#define CONN_CREATE_PARAM \
+	BT_CONN_LE_CREATE_PARAM(BT_CONN_LE_OPT_CODED, \
+				BT_GAP_SCAN_FAST_INTERVAL, \
+				BT_GAP_SCAN_FAST_WINDOW)
+#else
+#define CONN_CREATE_PARAM BT_CONN_LE_CREATE_CONN
+#endif
+
 // Called for each advertising data element in the advertising data.
 static bool ad_found(struct bt_data *data, void *user_data)
 {
@@ -254,25 +619,34 @@ static bool ad_found(struct bt_data *data, void *user_data)
 		}
 
 		struct bt_le_conn_param *param;
-		struct bt_uuid uuid;
+		struct bt_uuid_128 uuid;
+		struct bt_conn *conn;
 		int err;
 
-		bt_uuid_create(&uuid, data->data, 16);
-		if (bt_uuid_cmp(&uuid, BT_UUID_DECLARE_128(ASSIGNMENT2_SERVICE_UUID)) == 0) {
+		bt_uuid_create(&uuid.uuid, data->data, 16);
+		if (bt_uuid_cmp(&uuid.uuid, BT_UUID_DECLARE_128(ASSIGNMENT2_SERVICE_UUID)) == 0) {
+			// Still advertising while connected to us.
+			conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, addr);
+			if (conn) {
+				bt_conn_unref(conn);
+				return false;
+			}
+
 			printk("Found matching advertisement\n");
 
-			err = bt_le_scan_stop();
-			if (err) {
-				printk("Stop LE scan failed (err %d)\n", err);
+			if (scan_connect_begin()) {
 				return false;
 			}
 
 			param = BT_LE_CONN_PARAM_DEFAULT;
-			err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, param, &default_conn);
+			err = bt_conn_le_create(addr, CONN_CREATE_PARAM, param, &conn);
 			if (err) {
 				printk("Create conn failed (err %d)\n", err);
-				start_scan();
+				scan_update();
+				return false;
 			}
+
+			checkpoints[bt_conn_index(conn)].conn = conn;
 		}
 
 		return false;
@@ -291,9 +665,12 @@ static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
 	// printk("[DEVICE]: %s, AD evt type %u, AD data len %u, RSSI %i\n",
 	//        dev, type, ad->len, rssi);
 
-	// We're only interested in connectable devices.
+	// We're only interested in connectable devices. Extended advertising
+	// reports (Coded PHY) are filtered on the service UUID, which the
+	// non-connectable relay advertisements do not carry.
 	if (type == BT_GAP_ADV_TYPE_ADV_IND ||
-	    type == BT_GAP_ADV_TYPE_ADV_DIRECT_IND) {
+	    type == BT_GAP_ADV_TYPE_ADV_DIRECT_IND ||
+	    type == BT_GAP_ADV_TYPE_EXT_ADV) {
 		// Helper function to parse the advertising data (AD) elements
 		// from the advertisement. This will call `ad_found()` for
 		// each element.
@@ -301,26 +678,6 @@ static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
 	}
 }
 
-static void start_scan(void)
-{
-	int err;
-
-	struct bt_le_scan_param scan_param = {
-		.type       = BT_LE_SCAN_TYPE_PASSIVE,
-		.options    = BT_LE_SCAN_OPT_NONE,
-		.interval   = BT_GAP_SCAN_FAST_INTERVAL,
-		.window     = BT_GAP_SCAN_FAST_WINDOW,
-	};
-
-	err = bt_le_scan_start(&scan_param, device_found);
-	if (err) {
-		printk("Scanning failed to start (err %d)\n", err);
-		return;
-	}
-
-	printk("Scanning successfully started\n");
-}
-
 static void bt_ready(int err)
 {
 	if (err) {
@@ -330,13 +687,21 @@ static void bt_ready(int err)
 
 	printk("Bluetooth initialized\n");
 
-	start_scan();
+	k_work_schedule(&latency_report_work, LATENCY_REPORT_INTERVAL);
+	energy_init();
+	metrics_init();
+
+	scan_init(device_found);
 }
 
 void main(void)
 {
 	int err;
 
+	// Failure leaves the console on the UART, nothing else depends on it.
+	(void)host_link_init();
+	dedup_init(tap_emit);
+
 	err = bt_enable(bt_ready);
 
 	if (err) {
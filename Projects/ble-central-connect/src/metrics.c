@@ -0,0 +1,91 @@
+#include <zephyr.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+#include "metrics.h"
+#include "central_stats.h"
+#include "dedup.h"
+#include "scan.h"
+#include "latency.h"
+#include "link_phy.h"
+#include "host_link.h"
+
+static void link_print(struct bt_conn *conn, void *user_data)
+{
+	char addr[BT_ADDR_STR_LEN];
+	struct link_phy_info phy;
+	struct bt_conn_info info;
+
+	if (bt_conn_get_info(conn, &info) || info.state != BT_CONN_STATE_CONNECTED ||
+	    link_phy_get(conn, &phy)) {
+		return;
+	}
+
+	bt_addr_to_str(&info.le.dst->a, addr, sizeof(addr));
+	host_link_printf(HOST_CHANNEL_STATS,
+			 "metrics link %s interval_us=%u latency=%u timeout_ms=%u "
+			 "tx_phy=%u rx_phy=%u phy_changes=%u\n",
+			 addr, info.le.interval * 1250, info.le.latency,
+			 info.le.timeout * 10, phy.tx_phy, phy.rx_phy,
+			 phy.changes);
+}
+
+static void report_handler(struct k_work *work)
+{
+	struct central_stats cst;
+	struct dedup_stats dst;
+	struct scan_stats sst;
+	struct host_link_stats hst;
+
+	central_stats_get(&cst);
+	host_link_printf(HOST_CHANNEL_STATS,
+			 "metrics central connected=%u notifications=%u "
+			 "taps=%u relayed=%u acks=%u ack_failures=%u "
+			 "time_syncs=%u\n",
+			 cst.connected, cst.notifications, cst.journal_records,
+			 cst.relayed, cst.journal_acks, cst.ack_failures,
+			 cst.time_syncs);
+
+	host_link_printf(HOST_CHANNEL_STATS,
+			 "metrics relay taps=%u hops=%u age_ms=%u "
+			 "age_max_ms=%u\n",
+			 cst.relayed, cst.relay_hops, cst.relay_age_ms,
+			 cst.relay_age_max_ms);
+
+	dedup_stats_get(&dst);
+	host_link_printf(HOST_CHANNEL_STATS,
+			 "metrics dedup accepted=%u duplicates=%u reordered=%u "
+			 "gaps=%u evicted=%u\n",
+			 dst.accepted, dst.duplicates, dst.reordered, dst.gaps,
+			 dst.evicted);
+
+	scan_stats_get(&sst);
+	host_link_printf(HOST_CHANNEL_STATS,
+			 "metrics scan mode=%u expected=%u starts=%u "
+			 "start_errors=%u connects=%u listen_ms=%u\n",
+			 sst.mode, sst.expected, sst.starts, sst.start_errors,
+			 sst.connects, sst.listen_ms);
+
+	for (int i = 0; i < HOST_CHANNEL_COUNT; i++) {
+		host_link_stats_get(i, &hst);
+		host_link_printf(HOST_CHANNEL_STATS,
+				 "metrics usb %s open=%u lines=%u dropped=%u "
+				 "fallback=%u used=%u slots=%u\n",
+				 host_channel_str(i), hst.open, hst.lines,
+				 hst.dropped, hst.fallback, hst.used,
+				 hst.slots);
+	}
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, link_print, NULL);
+	latency_metrics();
+
+	k_work_reschedule(k_work_delayable_from_work(work),
+			  METRICS_REPORT_INTERVAL);
+}
+
+static K_WORK_DELAYABLE_DEFINE(report_work, report_handler);
+
+void metrics_init(void)
+{
+	k_work_schedule(&report_work, METRICS_REPORT_INTERVAL);
+}
@@ -0,0 +1,16 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+// Periodic counter report for tools/metrics_exporter.py.
+//
+// Every METRICS_REPORT_INTERVAL the central prints its counters on the
+// stats channel as "metrics <group> [<label>] key=value ..." lines, with
+// the checkpoint address as label for per-link groups. Counters only grow
+// until a reboot; the exporter turns them into Prometheus series.
+
+#define METRICS_REPORT_INTERVAL K_SECONDS(10)
+
+// Starts the periodic report.
+void metrics_init(void);
+
+#endif // METRICS_H_
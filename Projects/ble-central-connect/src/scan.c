@@ -0,0 +1,264 @@
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gap.h>
+
+#include "scan.h"
+
+// Fast scanning gives up after this long without a new checkpoint.
+#define SCAN_FAST_TIMEOUT K_SECONDS(30)
+
+// Delay before retrying a failed scan start, doubled up to the maximum.
+#define SCAN_RETRY_MIN_MS 100
+#define SCAN_RETRY_MAX_MS 5000
+
+// Checkpoints in long range mode advertise on the Coded PHY. Scanning it
+// too runs a second window of the same length on that PHY every interval.
+#if defined(CONFIG_BT_CTLR_PHY_CODED)
+#define SCAN_OPTIONS (BT_LE_SCAN_OPT_FILTER_DUPLICATE | BT_LE_SCAN_OPT_CODED)
+#define SCAN_PHYS 2
+#else
+#define SCAN_OPTIONS BT_LE_SCAN_OPT_FILTER_DUPLICATE
+#define SCAN_PHYS 1
+#endif
+
+static const struct bt_le_scan_param mode_params[] = {
+	[SCAN_FAST] = {
+		.type     = BT_LE_SCAN_TYPE_PASSIVE,
+		.options  = SCAN_OPTIONS,
+		.interval = BT_GAP_SCAN_FAST_INTERVAL,   // 60 ms
+		.window   = BT_GAP_SCAN_FAST_WINDOW,     // 30 ms
+	},
+	// The window stays well below the connection interval, so the
+	// controller can schedule connection events around it.
+	[SCAN_SHARED] = {
+		.type     = BT_LE_SCAN_TYPE_PASSIVE,
+		.options  = SCAN_OPTIONS,
+		.interval = BT_GAP_SCAN_FAST_INTERVAL,   // 60 ms
+		.window   = BT_GAP_SCAN_SLOW_WINDOW_1,   // 11.25 ms
+	},
+	[SCAN_BACKOFF] = {
+		.type     = BT_LE_SCAN_TYPE_PASSIVE,
+		.options  = SCAN_OPTIONS,
+		.interval = BT_GAP_SCAN_SLOW_INTERVAL_1, // 1.28 s
+		.window   = BT_GAP_SCAN_SLOW_WINDOW_1,   // 11.25 ms
+	},
+};
+
+static bt_le_scan_cb_t scan_cb;
+static enum scan_mode mode = SCAN_OFF;
+static bool connecting;
+static bool backoff;
+static bool restart;
+static uint8_t expected = CONFIG_BT_MAX_CONN;
+static uint32_t retry_ms = SCAN_RETRY_MIN_MS;
+static struct scan_stats stats;
+static K_MUTEX_DEFINE(scan_lock);
+
+// Time spent listening, window over interval of every mode scanned in.
+static int64_t mode_since;
+static uint64_t listen_us;
+
+static void scan_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(scan_work, scan_handler);
+
+static void backoff_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(backoff_work, backoff_handler);
+
+static void conn_count(struct bt_conn *conn, void *user_data)
+{
+	uint8_t *count = user_data;
+	struct bt_conn_info info;
+
+	if (!bt_conn_get_info(conn, &info) && info.role == BT_CONN_ROLE_CENTRAL) {
+		(*count)++;
+	}
+}
+
+static uint8_t connected_count(void)
+{
+	uint8_t count = 0;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, conn_count, &count);
+
+	return count;
+}
+
+static uint64_t listen_us_since(int64_t now)
+{
+	const struct bt_le_scan_param *p = &mode_params[mode];
+
+	if (mode == SCAN_OFF) {
+		return 0;
+	}
+
+	return (now - mode_since) * 1000 * SCAN_PHYS * p->window / p->interval;
+}
+
+static void mode_set(enum scan_mode next)
+{
+	int64_t now = k_uptime_get();
+
+	listen_us += listen_us_since(now);
+	mode_since = now;
+	mode = next;
+}
+
+static enum scan_mode mode_select(uint8_t connected)
+{
+	if (connecting || connected >= expected) {
+		return SCAN_OFF;
+	}
+	if (backoff) {
+		return SCAN_BACKOFF;
+	}
+
+	return connected ? SCAN_SHARED : SCAN_FAST;
+}
+
+static void scan_handler(struct k_work *work)
+{
+	enum scan_mode next;
+	uint8_t connected = connected_count();
+	int err;
+
+	k_mutex_lock(&scan_lock, K_FOREVER);
+
+	stats.connected = connected;
+	next = mode_select(connected);
+	// Restarting also clears the controller's duplicate filter, so a
+	// checkpoint that was skipped while connected is reported again.
+	if (next == mode && !restart) {
+		goto out;
+	}
+	restart = false;
+
+	if (mode != SCAN_OFF) {
+		err = bt_le_scan_stop();
+		if (err && err != -EALREADY) {
+			printk("Stop LE scan failed (err %d)\n", err);
+		}
+		mode_set(SCAN_OFF);
+	}
+
+	if (next == SCAN_OFF) {
+		k_work_cancel_delayable(&backoff_work);
+		goto out;
+	}
+
+	err = bt_le_scan_start(&mode_params[next], scan_cb);
+	if (err) {
+		printk("Scanning failed to start (err %d), retry in %u ms\n",
+		       err, retry_ms);
+		stats.start_errors++;
+		k_work_reschedule(&scan_work, K_MSEC(retry_ms));
+		retry_ms = MIN(retry_ms * 2, SCAN_RETRY_MAX_MS);
+		goto out;
+	}
+
+	retry_ms = SCAN_RETRY_MIN_MS;
+	mode_set(next);
+	stats.starts++;
+	printk("Scanning (%s) for %u more checkpoint(s)\n", scan_mode_str(mode),
+	       expected - connected);
+
+	if (mode != SCAN_BACKOFF) {
+		k_work_reschedule(&backoff_work, SCAN_FAST_TIMEOUT);
+	}
+
+out:
+	stats.mode = mode;
+	k_mutex_unlock(&scan_lock);
+}
+
+static void backoff_handler(struct k_work *work)
+{
+	k_mutex_lock(&scan_lock, K_FOREVER);
+	backoff = true;
+	k_mutex_unlock(&scan_lock);
+
+	k_work_reschedule(&scan_work, K_NO_WAIT);
+}
+
+void scan_init(bt_le_scan_cb_t cb)
+{
+	scan_cb = cb;
+	k_work_reschedule(&scan_work, K_NO_WAIT);
+}
+
+void scan_update(void)
+{
+	k_mutex_lock(&scan_lock, K_FOREVER);
+	// A checkpoint just connected or dropped out, others are likely
+	// nearby: scan at full rate again.
+	connecting = false;
+	backoff = false;
+	restart = true;
+	k_mutex_unlock(&scan_lock);
+
+	k_work_reschedule(&scan_work, K_NO_WAIT);
+}
+
+int scan_connect_begin(void)
+{
+	int err = 0;
+
+	k_mutex_lock(&scan_lock, K_FOREVER);
+
+	if (connecting) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	if (mode != SCAN_OFF) {
+		err = bt_le_scan_stop();
+		if (err) {
+			printk("Stop LE scan failed (err %d)\n", err);
+			goto out;
+		}
+		mode_set(SCAN_OFF);
+	}
+
+	connecting = true;
+	stats.connects++;
+
+out:
+	stats.mode = mode;
+	k_mutex_unlock(&scan_lock);
+
+	return err;
+}
+
+void scan_expected_set(uint8_t count)
+{
+	k_mutex_lock(&scan_lock, K_FOREVER);
+	expected = MIN(count, CONFIG_BT_MAX_CONN);
+	backoff = false;
+	k_mutex_unlock(&scan_lock);
+
+	k_work_reschedule(&scan_work, K_NO_WAIT);
+}
+
+void scan_stats_get(struct scan_stats *out)
+{
+	k_mutex_lock(&scan_lock, K_FOREVER);
+	*out = stats;
+	out->expected = expected;
+	out->listen_ms = (listen_us + listen_us_since(k_uptime_get())) / 1000;
+	k_mutex_unlock(&scan_lock);
+}
+
+const char *scan_mode_str(enum scan_mode m)
+{
+	switch (m) {
+	case SCAN_FAST:
+		return "fast";
+	case SCAN_SHARED:
+		return "shared";
+	case SCAN_BACKOFF:
+		return "backoff";
+	default:
+		return "off";
+	}
+}
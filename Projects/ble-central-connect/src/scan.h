@@ -0,0 +1,46 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/bluetooth.h>
+
+// Scan scheduler.
+//
+// Scans with a high duty cycle only while expected checkpoints are
+// missing, shares the radio with the established links, and backs off to
+// a low duty cycle when nothing new shows up for a while.
+
+enum scan_mode {
+	SCAN_OFF,     // All expected checkpoints connected, or connecting.
+	SCAN_FAST,    // Nothing connected yet.
+	SCAN_SHARED,  // Short window between connection events.
+	SCAN_BACKOFF, // Nothing found for a while, low duty cycle.
+};
+
+struct scan_stats {
+	enum scan_mode mode;
+	uint8_t connected;
+	uint8_t expected;
+	uint32_t starts;       // Scan (re)starts with new parameters.
+	uint32_t start_errors; // Failed starts, retried with a backoff.
+	uint32_t connects;     // Connections initiated from the scan.
+	uint32_t listen_ms;    // Radio time spent in scan windows.
+};
+
+void scan_init(bt_le_scan_cb_t cb);
+
+// Re-evaluates the scan mode, after a connection or disconnection.
+void scan_update(void);
+
+// Stops scanning so a connection can be created. Scanning resumes with
+// scan_update() once the connection completes or fails.
+int scan_connect_begin(void);
+
+// Number of checkpoints to keep connected, at most CONFIG_BT_MAX_CONN.
+void scan_expected_set(uint8_t expected);
+
+void scan_stats_get(struct scan_stats *stats);
+
+const char *scan_mode_str(enum scan_mode mode);
+
+#endif // SCAN_H_
@@ -0,0 +1,33 @@
+#ifndef TAP_RECORD_H_
+#define TAP_RECORD_H_
+
+#include <zephyr/types.h>
+#include <sys/util.h>
+#include <toolchain.h>
+#include <bluetooth/addr.h>
+
+// Timestamp of the tap record is in this central's uptime.
+#define TAP_RECORD_SYNCED BIT(0)
+
+// Tap record sent by the checkpoint over the journal characteristic.
+// Multi-byte fields are little endian.
+struct tap_record {
+	uint32_t seq;
+	uint32_t timestamp;
+	uint8_t category;
+	uint8_t flags;
+} __packed;
+
+// Tap of an out-of-range checkpoint, notified by the checkpoint that
+// relayed it last over the relay characteristic.
+struct relay_pdu {
+	uint8_t version;
+	uint8_t ttl;
+	uint8_t hops;
+	uint8_t category;
+	bt_addr_le_t origin;
+	uint32_t seq;
+	uint16_t age_ms; // Time spent in the relays.
+} __packed;
+
+#endif // TAP_RECORD_H_
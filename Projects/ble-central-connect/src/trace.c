@@ -0,0 +1,80 @@
+#include <zephyr.h>
+#include <sys/byteorder.h>
+#include <string.h>
+
+#include "trace.h"
+
+static struct trace_entry ring[TRACE_ENTRIES];
+static uint32_t head;
+static uint32_t count;
+static bool enabled;
+static struct k_spinlock lock;
+
+void trace_enable(bool enable)
+{
+	enabled = enable;
+}
+
+bool trace_enabled(void)
+{
+	return enabled;
+}
+
+void trace_record(const bt_addr_le_t *peer, const struct tap_record *rec)
+{
+	struct trace_entry *e;
+	k_spinlock_key_t key;
+
+	if (!enabled) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+
+	// Overwrite the oldest entry when full.
+	e = &ring[(head + count) % ARRAY_SIZE(ring)];
+	if (count == ARRAY_SIZE(ring)) {
+		head = (head + 1) % ARRAY_SIZE(ring);
+	} else {
+		count++;
+	}
+
+	e->rx_ms = sys_cpu_to_le32(k_uptime_get_32());
+	e->tap_ms = rec->timestamp;
+	e->seq = rec->seq;
+	memcpy(e->peer, peer->a.val, sizeof(e->peer));
+	e->peer_type = peer->type;
+	e->category = rec->category;
+	e->flags = rec->flags;
+
+	k_spin_unlock(&lock, key);
+}
+
+bool trace_get(uint32_t i, struct trace_entry *entry)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool found = i < count;
+
+	if (found) {
+		*entry = ring[(head + i) % ARRAY_SIZE(ring)];
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return found;
+}
+
+uint32_t trace_count(void)
+{
+	return count;
+}
+
+void trace_clear(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	head = 0;
+	count = 0;
+
+	k_spin_unlock(&lock, key);
+}
@@ -0,0 +1,42 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/addr.h>
+
+#include "tap_record.h"
+
+// Tap trace recorder.
+//
+// Keeps the last TRACE_ENTRIES taps, after deduplication, in a RAM ring
+// while recording is enabled. "checkpoint trace dump" prints them as hex
+// lines that tools/trace_replay.py turns back into taps on checkpoints.
+
+#define TRACE_ENTRIES 512
+#define TRACE_VERSION 1
+
+// One traced tap. Multi-byte fields are little endian.
+struct trace_entry {
+	uint32_t rx_ms;    // Central uptime when the tap was received.
+	uint32_t tap_ms;   // Tap time, central uptime if synced.
+	uint32_t seq;
+	uint8_t peer[6];   // Checkpoint address, little endian.
+	uint8_t peer_type;
+	uint8_t category;
+	uint8_t flags;     // TAP_RECORD_* flags.
+} __packed;
+
+void trace_enable(bool enable);
+
+bool trace_enabled(void);
+
+void trace_record(const bt_addr_le_t *peer, const struct tap_record *rec);
+
+// Copies out entry i, 0 being the oldest. Returns false past the end.
+bool trace_get(uint32_t i, struct trace_entry *entry);
+
+uint32_t trace_count(void);
+
+void trace_clear(void);
+
+#endif // TRACE_H_
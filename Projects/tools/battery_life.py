@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Project the battery life of a checkpoint from its energy counters.
+
+Takes a console capture with "energy key=value ..." lines, printed by
+"checkpoint energy" or periodically with CONFIG_CHECKPOINT_ENERGY_REPORT_S,
+splits the active times into a fixed part and a part per tap, and applies
+them to a tap profile:
+
+    battery_life.py capture.log --taps-per-hour 120 --capacity 2600
+
+The split needs captures over periods with different tap rates; with a
+single period the per-tap costs come from --tap-radio-ms and
+--tap-cpu-ms. Currents are nRF52840 figures at 3 V with the DC/DC
+regulator and can be overridden with --current NAME=mA.
+
+For a BabbleSim run, --bsim-dump reads the radio activity of one device
+from the 2G4 phy dump files (d_<phy>_<device>.Tx.csv and .Rx.csv) and
+splits it into transmit and receive. The BabbleSim images build without
+CONFIG_CHECKPOINT_ENERGY, so the capture is optional there: without it
+the radio share is the simulated one as is, and the CPU share comes from
+--tap-cpu-ms at --taps-per-hour:
+
+    battery_life.py --bsim-dump sim/results --bsim-device 0 \
+        --taps-per-hour 120
+
+A capture of the same run, if there is one, calibrates the counted
+radio time against the simulated one instead.
+"""
+
+import argparse
+import csv
+import glob
+import os
+import re
+import sys
+
+# Average currents in mA.
+CURRENTS = {
+    "sleep": 0.0031,    # System ON, RTC running, full RAM retention.
+    "cpu": 3.3,         # CPU running from flash at 64 MHz.
+    "radio": 5.0,       # Radio active, TX 0 dBm and RX averaged.
+    "tx": 4.8,          # Radio transmitting at 0 dBm.
+    "rx": 4.6,          # Radio receiving at 1 Mbps.
+    "nfc_field": 0.4,   # NFCT activated by a reader field.
+    "led": 0.0,         # Continuously lit LEDs, none on production boards.
+}
+
+# Radio ramp-up before every BabbleSim transmission or reception (us).
+RAMP_US = 40
+
+LINE_RE = re.compile(r"energy((?: \w+=\d+)+)")
+
+
+def parse(path):
+    samples = []
+
+    with open(path, errors="replace") as f:
+        for line in f:
+            m = LINE_RE.search(line)
+            if not m:
+                continue
+            sample = dict((k, int(v)) for k, v in
+                          (kv.split("=") for kv in m.group(1).split()))
+            # A reboot restarts the counters, keep the last boot only.
+            if samples and sample["uptime_ms"] < samples[-1]["uptime_ms"]:
+                samples = []
+            samples.append(sample)
+
+    if not samples:
+        sys.exit("%s: no energy lines" % path)
+
+    return samples
+
+
+def radio_ms(sample):
+    """Radio time of a sample, counted on the checkpoint or estimated from
+    the scan windows and connection events on the central."""
+    if "radio_ms" in sample:
+        return sample["radio_ms"]
+    return sample.get("scan_ms", 0) + sample.get("conn_ms", 0)
+
+
+def fit(periods, key, default_per_tap):
+    """Least squares fit of value = base * dt + per_tap * dtaps over the
+    periods, base in ms per ms, per_tap in ms. Falls back to the default
+    per-tap cost when the tap rate did not change enough."""
+    sxx = sum(p["dt"] ** 2 for p in periods)
+    syy = sum(p["taps"] ** 2 for p in periods)
+    sxy = sum(p["dt"] * p["taps"] for p in periods)
+    sxv = sum(p["dt"] * p[key] for p in periods)
+    syv = sum(p["taps"] * p[key] for p in periods)
+    det = sxx * syy - sxy * sxy
+
+    if len(periods) >= 3 and det > 1e-9 * sxx * max(syy, 1):
+        base = (syy * sxv - sxy * syv) / det
+        per_tap = (sxx * syv - sxy * sxv) / det
+        if base >= 0 and per_tap >= 0:
+            return base, per_tap, True
+
+    total_t = sum(p["dt"] for p in periods)
+    total_taps = sum(p["taps"] for p in periods)
+    total_v = sum(p[key] for p in periods)
+    base = max(total_v - default_per_tap * total_taps, 0) / total_t
+
+    return base, default_per_tap, False
+
+
+def periods_of(samples):
+    points = [{"t": 0, "taps": 0, "cpu": 0, "radio": 0, "field": 0}]
+    points += [{
+        "t": s["uptime_ms"],
+        "taps": s.get("taps", s.get("notifications", 0)),
+        "cpu": s.get("cpu_ms", 0),
+        "radio": radio_ms(s),
+        "field": s.get("nfc_field_ms", 0),
+    } for s in samples]
+
+    periods = []
+    for a, b in zip(points, points[1:]):
+        if b["t"] <= a["t"]:
+            continue
+        periods.append({
+            "dt": b["t"] - a["t"],
+            "taps": b["taps"] - a["taps"],
+            "cpu": b["cpu"] - a["cpu"],
+            "radio": b["radio"] - a["radio"],
+            "field": b["field"] - a["field"],
+        })
+
+    return periods
+
+
+def bsim_radio(dump_dir, device):
+    """Transmit and receive time in us and the simulated span in us."""
+    tx_us = rx_us = end = 0
+
+    for path in glob.glob(os.path.join(dump_dir, "d_*_%d.Tx.csv" % device)):
+        with open(path) as f:
+            for row in csv.DictReader(f):
+                start, stop = int(row["start_time"]), int(row["end_time"])
+                tx_us += stop - start + RAMP_US
+                end = max(end, stop)
+
+    for path in glob.glob(os.path.join(dump_dir, "d_*_%d.Rx.csv" % device)):
+        with open(path) as f:
+            for row in csv.DictReader(f):
+                start = int(row["start_time"])
+                stop = int(row.get("payload_end") or 0) or \
+                    int(row.get("sync_end") or 0) or \
+                    start + int(row["scan_duration"])
+                rx_us += max(stop - start, 0) + RAMP_US
+                end = max(end, stop)
+
+    if not end:
+        sys.exit("%s: no phy dump for device %d" % (dump_dir, device))
+
+    return tx_us, rx_us, end
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", nargs="?",
+                        help="console capture with energy lines, optional "
+                             "with --bsim-dump")
+    parser.add_argument("--taps-per-hour", type=float,
+                        help="tap profile, default the captured rate")
+    parser.add_argument("--capacity", type=float, default=2600,
+                        help="battery capacity (mAh)")
+    parser.add_argument("--usable", type=float, default=0.8,
+                        help="fraction of the capacity usable down to the "
+                             "cut-off voltage")
+    parser.add_argument("--tap-radio-ms", type=float, default=50.0,
+                        help="radio time per tap when it cannot be fitted")
+    parser.add_argument("--tap-cpu-ms", type=float, default=5.0,
+                        help="CPU time per tap when it cannot be fitted")
+    parser.add_argument("--current", action="append", default=[],
+                        metavar="NAME=mA",
+                        help="override a current: %s" % ", ".join(CURRENTS))
+    parser.add_argument("--bsim-dump", metavar="DIR",
+                        help="BabbleSim phy dump directory")
+    parser.add_argument("--bsim-device", type=int, default=0,
+                        help="device number in the BabbleSim run")
+    args = parser.parse_args()
+
+    currents = dict(CURRENTS)
+    for c in args.current:
+        name, _, value = c.partition("=")
+        if name not in currents:
+            sys.exit("unknown current %s" % name)
+        currents[name] = float(value)
+
+    if args.capture:
+        samples = parse(args.capture)
+        periods = periods_of(samples)
+        if not periods:
+            sys.exit("no period with elapsed time")
+
+        span_ms = sum(p["dt"] for p in periods)
+        taps = sum(p["taps"] for p in periods)
+        captured_rate = taps * 3600000.0 / span_ms
+        rate = captured_rate if args.taps_per_hour is None \
+            else args.taps_per_hour
+
+        cpu_base, cpu_tap, cpu_fit = fit(periods, "cpu", args.tap_cpu_ms)
+        radio_base, radio_tap, radio_fit = fit(periods, "radio",
+                                               args.tap_radio_ms)
+        field_tap = sum(p["field"] for p in periods) / taps if taps else 0
+    elif args.bsim_dump:
+        # Nothing counted: the radio comes from the phy dump alone.
+        if args.taps_per_hour is None:
+            parser.error("--taps-per-hour is needed without a capture")
+        samples = []
+        span_ms = taps = captured_rate = 0
+        rate = args.taps_per_hour
+        cpu_base, cpu_tap, cpu_fit = 0.0, args.tap_cpu_ms, False
+        radio_base, radio_tap, radio_fit = 0.0, args.tap_radio_ms, False
+        field_tap = 0
+    else:
+        parser.error("a capture or --bsim-dump is needed")
+
+    taps_per_ms = rate / 3600000.0
+
+    # Fractions of time each block is active under the profile.
+    cpu = cpu_base + cpu_tap * taps_per_ms
+    radio = radio_base + radio_tap * taps_per_ms
+    field = field_tap * taps_per_ms
+
+    parts = [
+        ("sleep", currents["sleep"]),
+        ("cpu", currents["cpu"] * cpu),
+        ("nfc field", currents["nfc_field"] * field),
+        ("led", currents["led"]),
+    ]
+
+    if args.bsim_dump:
+        tx_us, rx_us, end_us = bsim_radio(args.bsim_dump, args.bsim_device)
+        counted = radio_ms(samples[-1]) / float(samples[-1]["uptime_ms"]) \
+            if samples else 0
+        simulated = (tx_us + rx_us) / float(end_us)
+        # Calibrate the counted radio time against the simulated one.
+        radio = radio * simulated / counted if counted else simulated
+        tx_share = tx_us / float(tx_us + rx_us)
+        parts.append(("radio tx", currents["tx"] * radio * tx_share))
+        parts.append(("radio rx", currents["rx"] * radio * (1 - tx_share)))
+    else:
+        parts.append(("radio", currents["radio"] * radio))
+
+    total = sum(ma for _, ma in parts)
+    hours = args.capacity * args.usable / total
+
+    if samples:
+        print("captured %.1f h, %u taps (%.1f/h), profile %.1f taps/h" %
+              (span_ms / 3600000.0, taps, captured_rate, rate))
+    else:
+        print("simulated %.1f s, profile %.1f taps/h" %
+              (end_us / 1e6, rate))
+    print("per tap: cpu %.2f ms%s, radio %.2f ms%s, field %.0f ms" %
+          (cpu_tap, "" if cpu_fit else " (default)",
+           radio_tap, "" if radio_fit else " (default)", field_tap))
+    print()
+    print("%-10s %10s %6s" % ("block", "avg uA", "share"))
+    for name, ma in parts:
+        print("%-10s %10.1f %5.1f%%" % (name, ma * 1000, 100 * ma / total))
+    print("%-10s %10.1f" % ("total", total * 1000))
+    print()
+    print("%.0f mAh x %.0f%% lasts %.0f days" %
+          (args.capacity, args.usable * 100, hours / 24))
+
+
+if __name__ == "__main__":
+    main()
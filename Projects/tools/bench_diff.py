@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Compare two storage benchmark runs of a checkpoint.
+
+Takes console captures of "checkpoint bench" before and after a change
+and prints the mean and worst durations side by side:
+
+    bench_diff.py before.log after.log --limit 10
+
+With --limit, exits with an error when a mean got slower by more than
+that many percent.
+"""
+
+import argparse
+import sys
+
+
+def parse(path):
+    results = {}
+
+    with open(path, errors="replace") as f:
+        for line in f:
+            start = line.find("bench,")
+            if start < 0:
+                continue
+            fields = line[start:].strip().split(",")
+            if len(fields) != 7 or fields[1] == "name":
+                continue
+            count, min_us, mean_us, max_us, size = map(int, fields[2:])
+            results[fields[1]] = {"count": count, "min": min_us,
+                                  "mean": mean_us, "max": max_us,
+                                  "bytes": size}
+
+    if not results:
+        sys.exit("%s: no benchmark lines" % path)
+
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--limit", type=float,
+                        help="allowed slowdown of a mean in percent")
+    args = parser.parse_args()
+
+    before = parse(args.before)
+    after = parse(args.after)
+    slower = []
+
+    print("%-10s %10s %10s %8s %10s %10s" %
+          ("operation", "mean us", "was", "change", "max us", "was"))
+    for name in sorted(set(before) & set(after)):
+        b, a = before[name], after[name]
+        change = 100.0 * (a["mean"] - b["mean"]) / b["mean"] \
+            if b["mean"] else 0.0
+        print("%-10s %10u %10u %+7.1f%% %10u %10u" %
+              (name, a["mean"], b["mean"], change, a["max"], b["max"]))
+        if args.limit is not None and change > args.limit:
+            slower.append(name)
+
+    if slower:
+        sys.exit("slower than %g%%: %s" % (args.limit, ", ".join(slower)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Forward the taps reported by centrals to the polls backend.
+
+Reads the console of one or more centrals and posts every
+"Tap #<seq> from <addr>: category <n> at <ms> ms" line as JSON to the
+backend:
+
+    checkpoint_bridge.py --backend http://localhost:8000/polls/checkin/ \\
+        /dev/ttyACM0 /dev/ttyACM1
+
+Taps go through a bounded queue to a pool of workers, each holding a
+persistent HTTP connection. When the queue is full the oldest tap is
+dropped and counted, so a stalled backend never stalls the serial
+readers.
+"""
+
+import argparse
+import http.client
+import json
+import queue
+import re
+import sys
+import threading
+import time
+import urllib.parse
+
+from ttyio import open_port, read_lines
+
+TAP_RE = re.compile(r"Tap #(\d+) from ([0-9A-F:]{17}) \((\w+)\): "
+                    r"category (\d+) at (\d+) ms")
+
+
+def parse_tap(line):
+    """Returns the tap reported by a central console line, or None."""
+    m = TAP_RE.search(line)
+    if not m:
+        return None
+
+    return {
+        "checkpoint": m.group(2),
+        "seq": int(m.group(1)),
+        "category": int(m.group(4)),
+        "tap_ms": int(m.group(5)),
+    }
+
+
+class Bridge:
+    """Serial readers, a bounded queue and the HTTP posting workers."""
+
+    def __init__(self, backend, workers=2, queue_len=1024, timeout=5.0):
+        url = urllib.parse.urlsplit(backend)
+        self.host = url.hostname
+        self.port = url.port or (443 if url.scheme == "https" else 80)
+        self.https = url.scheme == "https"
+        self.path = url.path or "/"
+        self.timeout = timeout
+        self.queue = queue.Queue(queue_len)
+        self.lock = threading.Lock()
+        self.stats = {"lines": 0, "taps": 0, "posted": 0, "failed": 0,
+                      "dropped": 0}
+        self.workers = [threading.Thread(target=self._worker, daemon=True)
+                        for _ in range(workers)]
+
+    def _count(self, key, n=1):
+        with self.lock:
+            self.stats[key] += n
+
+    def snapshot(self):
+        with self.lock:
+            out = dict(self.stats)
+        out["queued"] = self.queue.qsize()
+        return out
+
+    def start(self):
+        for w in self.workers:
+            w.start()
+
+    def submit(self, tap):
+        self._count("taps")
+        while True:
+            try:
+                self.queue.put_nowait(tap)
+                return
+            except queue.Full:
+                pass
+            try:
+                self.queue.get_nowait()
+                self._count("dropped")
+            except queue.Empty:
+                pass
+
+    def read_port(self, path, baud):
+        for line in read_lines(open_port(path, baud)):
+            self._count("lines")
+            tap = parse_tap(line)
+            if tap is not None:
+                tap["port"] = path
+                self.submit(tap)
+
+    def _connect(self):
+        cls = http.client.HTTPSConnection if self.https else \
+            http.client.HTTPConnection
+        return cls(self.host, self.port, timeout=self.timeout)
+
+    def _worker(self):
+        conn = None
+
+        while True:
+            tap = self.queue.get()
+            body = json.dumps(tap).encode()
+            try:
+                if conn is None:
+                    conn = self._connect()
+                conn.request("POST", self.path, body,
+                             {"Content-Type": "application/json"})
+                resp = conn.getresponse()
+                resp.read()
+                self._count("posted" if resp.status < 300 else "failed")
+            except (OSError, http.client.HTTPException):
+                self._count("failed")
+                if conn is not None:
+                    conn.close()
+                conn = None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("ports", nargs="+", help="central console ttys")
+    parser.add_argument("--backend", required=True,
+                        help="URL the taps are posted to")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--workers", type=int, default=2,
+                        help="concurrent HTTP connections")
+    parser.add_argument("--queue", type=int, default=1024,
+                        help="taps buffered before the oldest is dropped")
+    parser.add_argument("--stats", type=float, default=0,
+                        metavar="SECONDS",
+                        help="print the counters to stderr this often")
+    args = parser.parse_args()
+
+    bridge = Bridge(args.backend, args.workers, args.queue)
+    bridge.start()
+
+    readers = [threading.Thread(target=bridge.read_port, args=(p, args.baud),
+                                daemon=True) for p in args.ports]
+    for r in readers:
+        r.start()
+
+    try:
+        while any(r.is_alive() for r in readers):
+            time.sleep(args.stats or 1.0)
+            if args.stats:
+                print(" ".join("%s %u" % kv for kv in
+                               bridge.snapshot().items()),
+                      file=sys.stderr, flush=True)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
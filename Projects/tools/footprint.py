@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""RAM and flash footprint of a firmware image, per module and per buffer.
+
+Reads the symbol table and line information of the ELF file with nm and
+attributes every symbol to a module: the source file for application
+code, the subsystem directory for the SDK. The result is checked against
+a budget file:
+
+    {
+      "ram": 65536, "flash": 262144,
+      "modules": {"main.c": {"ram": 2048, "flash": 8192}},
+      "symbols": {"main.c:ndef_msg_buf": 1024},
+      "new_symbol_max": 512
+    }
+
+Totals, modules and symbols are upper bounds. An application symbol in
+RAM that is not listed and larger than new_symbol_max also fails the
+check, so a new large buffer needs a budget entry. --update rewrites the
+budget from the image with some headroom, after an intended change.
+
+Both applications run it from their build: "west build -t footprint" for
+the checkpoint, "pio run -t footprint" for the central.
+"""
+
+import argparse
+import collections
+import json
+import os
+import subprocess
+import sys
+
+# Directories whose subsystems are reported as one module each.
+SDK_ROOTS = ("zephyr", "framework-zephyr", "nrf", "nrfxlib", "modules")
+SDK_DEPTH = 2
+
+# nm symbol types and the memories they occupy.
+FLASH_TYPES = set("tTrRvVwW")
+RAM_TYPES = set("bBsS")
+DATA_TYPES = set("dDgG")  # Initialized data: RAM plus its image in flash.
+
+
+def module_of(path, src_dirs):
+    if not path:
+        return "(no line info)"
+
+    path = os.path.normpath(path)
+    for src in src_dirs:
+        if path.startswith(src + os.sep):
+            return os.path.relpath(path, src)
+
+    parts = path.split(os.sep)
+    for i in range(len(parts) - 2, -1, -1):
+        if parts[i] in SDK_ROOTS:
+            root = "zephyr" if parts[i] == "framework-zephyr" else parts[i]
+            return "/".join([root] + parts[i + 1:-1][:SDK_DEPTH])
+
+    return "(other)"
+
+
+def read_symbols(nm, elf, src_dirs):
+    out = subprocess.run([nm, "--print-size", "--line-numbers",
+                          "--defined-only", elf],
+                         check=True, capture_output=True, text=True).stdout
+    symbols = []
+
+    for line in out.splitlines():
+        fields, _, where = line.partition("\t")
+        fields = fields.split()
+        if len(fields) != 4:
+            continue  # No size, e.g. linker defined symbols.
+
+        _, size, kind, name = fields
+        size = int(size, 16)
+        path = where.rsplit(":", 1)[0] if where else ""
+        if kind in FLASH_TYPES:
+            ram, flash = 0, size
+        elif kind in RAM_TYPES:
+            ram, flash = size, 0
+        elif kind in DATA_TYPES:
+            ram, flash = size, size
+        else:
+            continue
+
+        module = module_of(path, src_dirs)
+        symbols.append({
+            "name": name,
+            "module": module,
+            "app": any(os.path.normpath(path).startswith(s + os.sep)
+                       for s in src_dirs) if path else False,
+            "ram": ram,
+            "flash": flash,
+        })
+
+    return symbols
+
+
+def summarize(symbols):
+    modules = collections.defaultdict(lambda: {"ram": 0, "flash": 0})
+
+    for s in symbols:
+        modules[s["module"]]["ram"] += s["ram"]
+        modules[s["module"]]["flash"] += s["flash"]
+
+    return {
+        "ram": sum(s["ram"] for s in symbols),
+        "flash": sum(s["flash"] for s in symbols),
+        "modules": dict(modules),
+        "buffers": {"%s:%s" % (s["module"], s["name"]): s["ram"]
+                    for s in symbols if s["app"] and s["ram"]},
+    }
+
+
+def check(summary, budget):
+    errors = []
+
+    for key in ("ram", "flash"):
+        if key in budget and summary[key] > budget[key]:
+            errors.append("total %s %u > %u" %
+                          (key, summary[key], budget[key]))
+
+    for name, limits in budget.get("modules", {}).items():
+        used = summary["modules"].get(name, {"ram": 0, "flash": 0})
+        for key, limit in limits.items():
+            if used[key] > limit:
+                errors.append("%s %s %u > %u" % (name, key, used[key], limit))
+
+    listed = budget.get("symbols", {})
+    new_max = budget.get("new_symbol_max")
+    for name, size in summary["buffers"].items():
+        if name in listed:
+            if size > listed[name]:
+                errors.append("%s %u > %u" % (name, size, listed[name]))
+        elif new_max is not None and size > new_max:
+            errors.append("%s %u not in budget (limit %u)" %
+                          (name, size, new_max))
+
+    return errors
+
+
+def update(summary, budget, headroom, min_buffer):
+    scale = 1 + headroom / 100.0
+
+    budget["ram"] = int(summary["ram"] * scale)
+    budget["flash"] = int(summary["flash"] * scale)
+    budget["modules"] = {
+        name: {k: int(v * scale) for k, v in used.items()}
+        for name, used in sorted(summary["modules"].items())
+        if name in budget.get("modules", {}) or "/" not in name}
+    budget["symbols"] = {
+        name: size for name, size in sorted(summary["buffers"].items())
+        if size >= min_buffer}
+    budget.setdefault("new_symbol_max", min_buffer)
+
+    return budget
+
+
+def report(summary, top):
+    print("%-36s %8s %8s" % ("module", "ram", "flash"))
+    for name, used in sorted(summary["modules"].items(),
+                             key=lambda kv: -(kv[1]["ram"] + kv[1]["flash"])):
+        print("%-36s %8u %8u" % (name, used["ram"], used["flash"]))
+    print("%-36s %8u %8u" % ("total", summary["ram"], summary["flash"]))
+
+    print()
+    print("%-36s %8s" % ("application buffer", "ram"))
+    for name, size in sorted(summary["buffers"].items(),
+                             key=lambda kv: -kv[1])[:top]:
+        print("%-36s %8u" % (name, size))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf")
+    parser.add_argument("--nm", default="arm-none-eabi-nm")
+    parser.add_argument("--src", action="append", default=[],
+                        help="application source directory, repeatable")
+    parser.add_argument("--budget", help="budget file to check against")
+    parser.add_argument("--update", action="store_true",
+                        help="rewrite the budget from this image")
+    parser.add_argument("--headroom", type=float, default=5.0,
+                        help="percent added to totals and modules by "
+                             "--update")
+    parser.add_argument("--min-buffer", type=int, default=256,
+                        help="smallest buffer --update records")
+    parser.add_argument("--top", type=int, default=15,
+                        help="application buffers listed")
+    parser.add_argument("--json", action="store_true",
+                        help="print the summary as JSON")
+    args = parser.parse_args()
+
+    src_dirs = [os.path.normpath(os.path.abspath(s)) for s in args.src]
+    summary = summarize(read_symbols(args.nm, args.elf, src_dirs))
+
+    if args.json:
+        json.dump(summary, sys.stdout, indent=2, sort_keys=True)
+        print()
+    else:
+        report(summary, args.top)
+
+    if not args.budget:
+        return
+
+    budget = {}
+    if os.path.exists(args.budget):
+        with open(args.budget) as f:
+            budget = json.load(f)
+
+    if args.update:
+        budget = update(summary, budget, args.headroom, args.min_buffer)
+        with open(args.budget, "w") as f:
+            json.dump(budget, f, indent=2)
+            f.write("\n")
+        print("budget written to %s" % args.budget, file=sys.stderr)
+        return
+
+    errors = check(summary, budget)
+    for e in errors:
+        print("footprint over budget: %s" % e, file=sys.stderr)
+    if errors:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Synthetic load for the central -> host -> backend chain.
+
+Emulates centrals on pseudo terminals, each printing the console output
+of a real central (tap lines plus the usual chatter) for its checkpoints,
+runs the host ingestion against them and a local stand-in of the polls
+backend, and measures what arrives:
+
+    load_gen.py --centrals 8 --checkpoints 4 --rate 5,10,20,40 --step 30
+
+Every step runs at the given taps/s per central. Attendees arrive at a
+checkpoint in groups, so taps come in bursts of --group taps on average,
+spaced like people queueing at a tag. Categories are drawn with
+--weights (Check-In, Info, Quiz, Survey).
+
+For each step the report shows the sustained rate delivered to the
+backend, the growth of the taps emitted but not yet delivered (a
+positive slope means the chain is past its ceiling), and the
+emit-to-backend delay percentiles.
+
+The ingestion defaults to checkpoint_bridge.py; --bridge runs another
+command instead, with {backend} and {ports} substituted.
+"""
+
+import argparse
+import json
+import os
+import random
+import shlex
+import subprocess
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+from ttyio import make_raw
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_BRIDGE = "%s %s --backend {backend} {ports}" % (
+    shlex.quote(sys.executable),
+    shlex.quote(os.path.join(TOOLS_DIR, "checkpoint_bridge.py")))
+
+# Spacing of the taps of one group of attendees at a checkpoint (s).
+GROUP_SPACING = 1.5
+
+CHATTER = (
+    "NFC Activity: NFC field detected",
+    "Notif success",
+    "Latency [ms] p50 18 p90 31 p99 57 max 64",
+)
+
+
+class Tracker:
+    """Emit and delivery times of every tap, keyed by checkpoint and seq."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.pending = {}
+        self.emitted = 0
+        self.delivered = 0
+        self.unknown = 0
+        self.delays = []
+
+    def emit(self, key):
+        with self.lock:
+            self.pending[key] = time.monotonic()
+            self.emitted += 1
+
+    def deliver(self, key):
+        now = time.monotonic()
+        with self.lock:
+            sent = self.pending.pop(key, None)
+            if sent is None:
+                self.unknown += 1
+                return
+            self.delivered += 1
+            self.delays.append(now - sent)
+
+    def sample(self):
+        with self.lock:
+            delays, self.delays = self.delays, []
+            return self.emitted, self.delivered, delays
+
+
+class Backend(BaseHTTPRequestHandler):
+    """Stand-in for the polls backend, accepts taps as JSON POSTs."""
+
+    tracker = None
+    service_time = 0.0
+    protocol_version = "HTTP/1.1"
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        try:
+            tap = json.loads(body)
+            key = (tap["checkpoint"], tap["seq"])
+        except (ValueError, KeyError):
+            self.send_response(400)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+
+        if self.service_time:
+            time.sleep(self.service_time)
+        self.tracker.deliver(key)
+        self.send_response(201)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+class Central(threading.Thread):
+    """One emulated central writing its console output to a PTY."""
+
+    def __init__(self, index, args, tracker):
+        super().__init__(daemon=True)
+        self.master, self.slave = os.openpty()
+        make_raw(self.slave)
+        self.path = os.ttyname(self.slave)
+        self.args = args
+        self.tracker = tracker
+        self.rng = random.Random(args.seed + index)
+        self.rate = 0.0
+        self.lag = 0.0
+        self.checkpoints = [
+            "C0:%02X:%02X:00:00:%02X" % (index >> 8, index & 0xff, i)
+            for i in range(args.checkpoints)]
+        self.seq = {addr: 0 for addr in self.checkpoints}
+        self.start_time = time.monotonic()
+        self.stop = threading.Event()
+
+    def write(self, line):
+        os.write(self.master, (line + "\r\n").encode())
+
+    def tap(self, addr):
+        category = self.rng.choices(range(4), self.args.weights)[0]
+        seq = self.seq[addr]
+        self.seq[addr] += 1
+        uptime = int((time.monotonic() - self.start_time) * 1000)
+
+        self.tracker.emit((addr, seq))
+        self.write("Tap #%u from %s (random): category %u at %u ms" %
+                   (seq, addr, category, uptime))
+
+    def run(self):
+        # Pending taps of the groups in progress, as (due, checkpoint).
+        due = []
+        next_group = time.monotonic()
+
+        while not self.stop.is_set():
+            now = time.monotonic()
+
+            if self.rate > 0 and now >= next_group:
+                addr = self.rng.choice(self.checkpoints)
+                size = 1
+                while self.rng.random() > 1.0 / self.args.group:
+                    size += 1
+                due.extend((next_group + i * GROUP_SPACING, addr)
+                           for i in range(size))
+                next_group += self.rng.expovariate(self.rate /
+                                                   self.args.group)
+            elif self.rate <= 0:
+                next_group = now
+
+            due.sort()
+            while due and due[0][0] <= now:
+                t, addr = due.pop(0)
+                self.lag = max(self.lag, now - t)
+                self.tap(addr)
+                if self.rng.random() < self.args.chatter:
+                    self.write(self.rng.choice(CHATTER))
+
+            wake = min([next_group] + [d[0] for d in due[:1]])
+            time.sleep(min(max(wake - time.monotonic(), 0), 0.1))
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def slope(samples):
+    """Least squares slope of (t, value) samples."""
+    n = len(samples)
+    if n < 2:
+        return 0.0
+    mt = sum(t for t, _ in samples) / n
+    mv = sum(v for _, v in samples) / n
+    var = sum((t - mt) ** 2 for t, _ in samples)
+    if not var:
+        return 0.0
+    return sum((t - mt) * (v - mv) for t, v in samples) / var
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--centrals", type=int, default=4)
+    parser.add_argument("--checkpoints", type=int, default=4,
+                        help="checkpoints per central")
+    parser.add_argument("--rate", default="1,2,5,10,20",
+                        help="taps/s per central, one value per step")
+    parser.add_argument("--step", type=float, default=20.0,
+                        help="duration of a step (s)")
+    parser.add_argument("--group", type=float, default=3.0,
+                        help="mean taps per group of attendees")
+    parser.add_argument("--weights", default="4,3,2,1",
+                        help="relative frequency of the four categories")
+    parser.add_argument("--chatter", type=float, default=0.5,
+                        help="other console lines per tap")
+    parser.add_argument("--backend-ms", type=float, default=0.0,
+                        help="service time of the stand-in backend (ms)")
+    parser.add_argument("--bridge", default=DEFAULT_BRIDGE,
+                        help="ingestion command, {backend} and {ports} "
+                             "are substituted")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rates = [float(r) for r in args.rate.split(",")]
+    args.weights = [float(w) for w in args.weights.split(",")]
+    if len(args.weights) != 4:
+        sys.exit("--weights needs four values")
+    if args.group < 1:
+        sys.exit("--group must be at least 1")
+
+    tracker = Tracker()
+    Backend.tracker = tracker
+    Backend.service_time = args.backend_ms / 1000.0
+    server = ThreadingHTTPServer(("127.0.0.1", 0), Backend)
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    backend = "http://127.0.0.1:%u/polls/checkin/" % server.server_port
+
+    centrals = [Central(i, args, tracker) for i in range(args.centrals)]
+    cmd = args.bridge.format(
+        backend=shlex.quote(backend),
+        ports=" ".join(shlex.quote(c.path) for c in centrals))
+    bridge = subprocess.Popen(cmd, shell=True)
+    for c in centrals:
+        c.start()
+
+    print("%6s %9s %9s %9s %9s %8s %8s %8s" %
+          ("rate", "emit/s", "deliv/s", "backlog", "growth/s",
+           "p50 ms", "p99 ms", "max ms"))
+
+    try:
+        for rate in rates:
+            for c in centrals:
+                c.rate = rate
+                c.lag = 0.0
+
+            t0 = time.monotonic()
+            e0, d0, _ = tracker.sample()
+            backlog = []
+            delays = []
+            while time.monotonic() - t0 < args.step:
+                time.sleep(1.0)
+                if bridge.poll() is not None:
+                    sys.exit("ingestion exited with %d" % bridge.returncode)
+                e, d, dl = tracker.sample()
+                delays += dl
+                backlog.append((time.monotonic() - t0, e - d))
+            elapsed = time.monotonic() - t0
+
+            print("%6g %9.1f %9.1f %9u %9.2f %8.1f %8.1f %8.1f" % (
+                rate * args.centrals, (e - e0) / elapsed, (d - d0) / elapsed,
+                e - d, slope(backlog),
+                percentile(delays, 50) * 1000,
+                percentile(delays, 99) * 1000,
+                max(delays, default=0) * 1000), flush=True)
+
+            lag = max(c.lag for c in centrals)
+            if lag > 0.5:
+                print("warning: emitters %.1f s behind, PTY writes "
+                      "are blocking" % lag, file=sys.stderr)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for c in centrals:
+            c.stop.set()
+        bridge.terminate()
+        bridge.wait()
+        server.shutdown()
+
+    e, d, _ = tracker.sample()
+    print("total emitted %u delivered %u undelivered %u unknown %u" %
+          (e, d, e - d, tracker.unknown))
+
+
+if __name__ == "__main__":
+    main()
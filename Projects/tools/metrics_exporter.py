@@ -0,0 +1,329 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Export the counters printed by centrals as Prometheus metrics.
+
+Reads the console of one or more centrals, or a capture on stdin with "-",
+and serves the counters in the Prometheus text format:
+
+    metrics_exporter.py --listen :9464 hall=/dev/ttyACM0 hall=/dev/ttyACM1
+
+A port may be prefixed with a central name; ports with the same name (the
+events and stats channels of one central) feed the same series, otherwise
+the port path is the name. With --textfile the metrics are also written to
+a file every --interval seconds, for the node_exporter textfile collector.
+
+The series come from the tap lines (taps, sequence gaps and the time of
+the last tap per checkpoint), the "energy" lines and the "metrics" lines
+the central prints every 10 seconds: link parameters and PHY per
+checkpoint, tap latency histograms, deduplication, scan and
+acknowledgement counters, and the depth of the USB console rings.
+"""
+
+import argparse
+import http.server
+import os
+import re
+import sys
+import threading
+import time
+
+from checkpoint_bridge import parse_tap
+from ttyio import open_port, read_lines
+
+METRICS_RE = re.compile(r"metrics (\w+)(?: ([0-9A-F:]{17}|[a-z]+))?"
+                        r"((?: \w+=\d+)+)")
+ENERGY_RE = re.compile(r"energy((?: \w+=\d+)+)")
+
+# Keys of "metrics" lines that are levels rather than running counts.
+GAUGES = {"connected", "expected", "mode", "open", "used", "slots",
+          "interval_us", "latency", "timeout_ms", "tx_phy", "rx_phy",
+          "max_ms", "age_max_ms"}
+
+# Label carried by the second word of a "metrics" line, per group.
+GROUP_LABELS = {"link": "checkpoint", "latency": "checkpoint",
+                "latency_bucket": "checkpoint", "usb": "channel"}
+
+# Upper bounds of the central's latency buckets (bucket_ms[] in latency.c),
+# so every histogram has the same series even before a bucket is hit.
+LATENCY_BUCKETS_MS = [2, 4, 6, 8, 10, 15, 20, 25, 30, 40, 50, 60, 80, 100,
+                      125, 150, 200, 250, 300, 400, 500, 750, 1000, 1500,
+                      2000, 3000, 5000, 10000]
+
+HELP = {
+    "checkpoint_taps_total": "Taps reported by the central.",
+    "checkpoint_tap_seq_gaps_total":
+        "Tap sequence numbers skipped, taps lost before the central.",
+    "checkpoint_tap_last_seq": "Sequence number of the last tap.",
+    "checkpoint_tap_last_seconds": "Host time of the last tap.",
+    "checkpoint_tap_latency_ms": "Tap to receive latency.",
+    "checkpoint_exporter_lines_total": "Console lines read.",
+    "checkpoint_exporter_ports_open": "Console ports being read.",
+}
+
+
+def kv_pairs(text):
+    return [(k, int(v)) for k, v in (kv.split("=") for kv in text.split())]
+
+
+def escape(value):
+    return value.replace("\\", "\\\\").replace("\"", "\\\"") \
+        .replace("\n", "\\n")
+
+
+def labels_str(labels):
+    if not labels:
+        return ""
+    return "{%s}" % ",".join('%s="%s"' % (k, escape(v)) for k, v in labels)
+
+
+class Exporter:
+    """Metric values by series, updated by the port readers."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        # name -> (type, help), in first seen order.
+        self.families = {}
+        # name -> {labels tuple: value}
+        self.values = {}
+        # (central, checkpoint) -> histogram state.
+        self.hists = {}
+        self.last_seq = {}
+
+    def _family(self, name, kind, help_text=None):
+        if name not in self.families:
+            self.families[name] = (kind, help_text or HELP.get(name, name))
+            self.values[name] = {}
+        return self.values[name]
+
+    def _set(self, name, kind, labels, value, help_text=None):
+        self._family(name, kind, help_text)[tuple(labels)] = value
+
+    def _add(self, name, labels, n=1):
+        series = self._family(name, "counter")
+        series[tuple(labels)] = series.get(tuple(labels), 0) + n
+
+    def port_open(self, central, n):
+        with self.lock:
+            series = self._family("checkpoint_exporter_ports_open", "gauge")
+            key = (("central", central),)
+            series[key] = series.get(key, 0) + n
+
+    def feed(self, central, line):
+        with self.lock:
+            self._add("checkpoint_exporter_lines_total",
+                      [("central", central)])
+
+            tap = parse_tap(line)
+            if tap is not None:
+                self._tap(central, tap)
+                return
+
+            m = METRICS_RE.search(line)
+            if m:
+                self._metrics(central, m.group(1), m.group(2),
+                              kv_pairs(m.group(3)))
+                return
+
+            m = ENERGY_RE.search(line)
+            if m:
+                for key, value in kv_pairs(m.group(1)):
+                    kind = "gauge" if key == "uptime_ms" else "counter"
+                    name = "checkpoint_central_energy_%s" % key
+                    if kind == "counter":
+                        name += "_total"
+                    self._set(name, kind, [("central", central)], value,
+                              "From the central's \"energy\" line.")
+
+    def _tap(self, central, tap):
+        labels = [("central", central), ("checkpoint", tap["checkpoint"])]
+        key = (central, tap["checkpoint"])
+        seq = tap["seq"]
+
+        self._add("checkpoint_taps_total", labels)
+        # Taps are emitted in sequence order after deduplication, so a
+        # jump forward is a gap. A jump back is a checkpoint reboot.
+        last = self.last_seq.get(key)
+        if last is not None and seq > last + 1:
+            self._add("checkpoint_tap_seq_gaps_total", labels, seq - last - 1)
+        self.last_seq[key] = seq
+        self._set("checkpoint_tap_last_seq", "gauge", labels, seq)
+        self._set("checkpoint_tap_last_seconds", "gauge", labels,
+                  round(time.time(), 3))
+
+    def _metrics(self, central, group, label, pairs):
+        labels = [("central", central)]
+        if label is not None:
+            labels.append((GROUP_LABELS.get(group, "name"), label))
+
+        if group in ("latency", "latency_bucket"):
+            self._latency(central, label, group, pairs)
+            if group == "latency_bucket":
+                return
+            pairs = [(k, v) for k, v in pairs if k == "max_ms"]
+
+        for key, value in pairs:
+            name = "checkpoint_%s_%s" % (group, key)
+            if key in GAUGES:
+                self._set(name, "gauge", labels, value,
+                          "From the central's \"metrics %s\" line." % group)
+            else:
+                self._set(name + "_total", "counter", labels, value,
+                          "From the central's \"metrics %s\" line." % group)
+
+    def _latency(self, central, checkpoint, group, pairs):
+        hist = self.hists.setdefault((central, checkpoint), {
+            "count": 0, "sum": 0, "buckets": {},
+            "pending": None, "pending_count": 0,
+        })
+
+        # A report is one "latency" line followed by bucket lines; the
+        # histogram is replaced once the bucket counts add up to it.
+        if group == "latency":
+            values = dict(pairs)
+            hist["pending"] = {}
+            hist["pending_count"] = values.get("count", 0)
+            hist["pending_sum"] = values.get("sum_ms", 0)
+        elif hist["pending"] is not None:
+            for key, value in pairs:
+                bound = float("inf") if key == "inf" else int(key)
+                hist["pending"][bound] = value
+        else:
+            return
+
+        if sum(hist["pending"].values()) == hist["pending_count"]:
+            hist["count"] = hist["pending_count"]
+            hist["sum"] = hist["pending_sum"]
+            hist["buckets"] = hist["pending"]
+            hist["pending"] = None
+            self._family("checkpoint_tap_latency_ms", "histogram")
+
+    def _render_hist(self, out):
+        name = "checkpoint_tap_latency_ms"
+        for (central, checkpoint), hist in sorted(self.hists.items()):
+            labels = [("central", central), ("checkpoint", checkpoint)]
+            bounds = sorted(set(LATENCY_BUCKETS_MS) |
+                            set(b for b in hist["buckets"]
+                                if b != float("inf")))
+            total = 0
+            for bound in bounds:
+                total += hist["buckets"].get(bound, 0)
+                out.append("%s_bucket%s %d" % (
+                    name, labels_str(labels + [("le", str(bound))]), total))
+            out.append("%s_bucket%s %d" % (
+                name, labels_str(labels + [("le", "+Inf")]), hist["count"]))
+            out.append("%s_sum%s %d" % (name, labels_str(labels),
+                                        hist["sum"]))
+            out.append("%s_count%s %d" % (name, labels_str(labels),
+                                          hist["count"]))
+
+    def render(self):
+        out = []
+
+        with self.lock:
+            for name, (kind, help_text) in self.families.items():
+                out.append("# HELP %s %s" % (name, help_text))
+                out.append("# TYPE %s %s" % (name, kind))
+                if kind == "histogram":
+                    self._render_hist(out)
+                    continue
+                for labels, value in sorted(self.values[name].items()):
+                    out.append("%s%s %s" % (name, labels_str(labels), value))
+
+        return "\n".join(out) + "\n"
+
+    def read_port(self, central, path, baud):
+        if path == "-":
+            lines = (line.rstrip("\r\n") for line in sys.stdin)
+        else:
+            lines = read_lines(open_port(path, baud))
+
+        self.port_open(central, 1)
+        try:
+            for line in lines:
+                self.feed(central, line)
+        finally:
+            self.port_open(central, -1)
+
+
+def serve(exporter, listen):
+    host, _, port = listen.rpartition(":")
+
+    class Handler(http.server.BaseHTTPRequestHandler):
+        def do_GET(self):
+            if self.path.split("?")[0] not in ("/", "/metrics"):
+                self.send_error(404)
+                return
+            body = exporter.render().encode()
+            self.send_response(200)
+            self.send_header("Content-Type",
+                             "text/plain; version=0.0.4; charset=utf-8")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def log_message(self, fmt, *args):
+            pass
+
+    server = http.server.ThreadingHTTPServer((host, int(port)), Handler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+
+def write_textfile(exporter, path):
+    # Renamed into place so the collector never reads a partial file.
+    tmp = "%s.%d.tmp" % (path, os.getpid())
+    with open(tmp, "w") as f:
+        f.write(exporter.render())
+    os.replace(tmp, path)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("ports", nargs="+", metavar="[NAME=]PORT",
+                        help="central console ttys, - for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--listen", metavar="[HOST]:PORT",
+                        help="serve /metrics over HTTP")
+    parser.add_argument("--textfile", metavar="PATH",
+                        help="write the metrics to this file")
+    parser.add_argument("--interval", type=float, default=15.0,
+                        help="seconds between textfile writes")
+    args = parser.parse_args()
+
+    if not args.listen and not args.textfile:
+        sys.exit("nothing to export to, give --listen or --textfile")
+
+    exporter = Exporter()
+    if args.listen:
+        serve(exporter, args.listen)
+
+    readers = []
+    for port in args.ports:
+        central, sep, path = port.partition("=")
+        if not sep:
+            central = path = port
+        readers.append(threading.Thread(target=exporter.read_port,
+                                        args=(central, path, args.baud),
+                                        daemon=True))
+    for r in readers:
+        r.start()
+
+    try:
+        while any(r.is_alive() for r in readers):
+            time.sleep(args.interval if args.textfile else 1.0)
+            if args.textfile:
+                write_textfile(exporter, args.textfile)
+        # Input ended, as with a capture on stdin: keep serving the final
+        # values until interrupted.
+        if args.textfile:
+            write_textfile(exporter, args.textfile)
+        while args.listen:
+            time.sleep(1.0)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
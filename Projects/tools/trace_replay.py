@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Replay a tap trace recorded by the central on real checkpoints.
+
+Capture the central console while running "checkpoint trace dump", then
+map every traced checkpoint address to the shell UART of a checkpoint:
+
+    trace_replay.py capture.log --map C3:2A:..:01=/dev/ttyACM1 --speed 2
+
+Every traced tap becomes a "checkpoint tap <category>" command, which
+feeds the same NFC event path as a phone. Taps are sent at their original
+spacing divided by --speed. Without --map the schedule is only printed.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+
+from ttyio import open_port
+
+TRACE_VERSION = 1
+# rx_ms, tap_ms, seq, peer[6], peer_type, category, flags
+ENTRY = struct.Struct("<III6sBBB")
+TAP_RECORD_SYNCED = 0x01
+
+
+def peer_str(peer, peer_type):
+    addr = ":".join("%02X" % b for b in reversed(peer))
+    return "%s (%s)" % (addr, "random" if peer_type else "public")
+
+
+def parse(lines):
+    """Returns the entries of the last complete dump in the capture."""
+    entries = None
+    dumps = []
+
+    for line in lines:
+        # The shell may prefix lines with the prompt or escape codes.
+        words = line.strip().split()
+        if not words:
+            continue
+        tag = next((w for w in words if w.startswith("trace")), None)
+        if tag is None:
+            continue
+        args = words[words.index(tag) + 1:]
+
+        if tag == "trace-begin":
+            if int(args[0]) != TRACE_VERSION:
+                sys.exit("unsupported trace version %s" % args[0])
+            entries = []
+        elif tag == "trace" and entries is not None and args:
+            raw = bytes.fromhex(args[0])
+            if len(raw) != ENTRY.size:
+                sys.exit("malformed trace entry: %s" % args[0])
+            rx_ms, tap_ms, seq, peer, peer_type, category, flags = \
+                ENTRY.unpack(raw)
+            entries.append({
+                "rx_ms": rx_ms,
+                "tap_ms": tap_ms,
+                "seq": seq,
+                "peer": peer_str(peer, peer_type),
+                "addr": peer_str(peer, peer_type).split()[0],
+                "category": category,
+                "synced": bool(flags & TAP_RECORD_SYNCED),
+            })
+        elif tag == "trace-end" and entries is not None:
+            dumps.append(entries)
+            entries = None
+
+    if not dumps:
+        sys.exit("no complete trace dump found")
+
+    return dumps[-1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", help="central console capture with a trace dump")
+    parser.add_argument("--map", action="append", default=[],
+                        metavar="ADDR=TTY",
+                        help="checkpoint address to shell UART, repeatable")
+    parser.add_argument("--speed", type=float, default=1.0,
+                        help="time scale, 2 replays twice as fast")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--time", choices=("tap", "rx"), default="tap",
+                        help="replay tap times (synced taps only) or "
+                             "receive times")
+    args = parser.parse_args()
+
+    if args.speed <= 0:
+        sys.exit("--speed must be positive")
+
+    with open(args.capture, errors="replace") as f:
+        entries = parse(f)
+
+    key = "tap_ms" if args.time == "tap" else "rx_ms"
+    if key == "tap_ms" and not all(e["synced"] for e in entries):
+        print("warning: unsynced taps, using receive times", file=sys.stderr)
+        key = "rx_ms"
+    entries.sort(key=lambda e: e[key])
+
+    ports = {}
+    for m in args.map:
+        addr, _, tty = m.partition("=")
+        ports[addr.upper()] = open_port(tty, args.baud)
+
+    start_ms = entries[0][key] if entries else 0
+    start = time.monotonic()
+    sent = skipped = 0
+
+    for e in entries:
+        due = (e[key] - start_ms) / 1000.0 / args.speed
+        delay = start + due - time.monotonic()
+        if ports and delay > 0:
+            time.sleep(delay)
+
+        fd = ports.get(e["addr"])
+        print("%9.3f s %s seq %u category %u%s" %
+              (due, e["peer"], e["seq"], e["category"],
+               "" if fd is not None or not ports else " (unmapped)"))
+        if fd is None:
+            skipped += 1
+            continue
+
+        os.write(fd, b"checkpoint tap %u\r\n" % e["category"])
+        sent += 1
+
+    print("%u taps replayed, %u unmapped" % (sent, skipped), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
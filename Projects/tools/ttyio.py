@@ -0,0 +1,46 @@
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Raw serial port access shared by the checkpoint host tools."""
+
+import os
+import termios
+
+
+def make_raw(fd, baud=None):
+    """Puts a tty in raw 8N1 mode, without echo or line editing."""
+    attrs = termios.tcgetattr(fd)
+    attrs[0] = 0                                    # iflag
+    attrs[1] = 0                                    # oflag
+    attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+    attrs[3] = 0                                    # lflag
+    if baud is not None:
+        speed = getattr(termios, "B%d" % baud)
+        attrs[4] = attrs[5] = speed
+    attrs[6][termios.VMIN] = 1
+    attrs[6][termios.VTIME] = 0
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+
+
+def open_port(path, baud):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    make_raw(fd, baud)
+    return fd
+
+
+def read_lines(fd):
+    """Yields the decoded lines read from fd until end of file."""
+    pending = b""
+
+    while True:
+        try:
+            chunk = os.read(fd, 4096)
+        except OSError:
+            # A pseudo terminal reports EIO once the other side closed.
+            chunk = b""
+        if not chunk:
+            return
+        pending += chunk
+        *lines, pending = pending.split(b"\n")
+        for line in lines:
+            yield line.rstrip(b"\r").decode(errors="replace")
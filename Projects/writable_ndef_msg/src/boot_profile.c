@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @ingroup nfc_writable_ndef_msg_example_boot_profile boot_profile.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Boot phase timestamps for the NFC activity checkpoint.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+
+#include "boot_profile.h"
+
+static const char *const phase_name[BOOT_PHASE_COUNT] = {
+	[BOOT_MAIN] = "main",
+	[BOOT_BOARD] = "board",
+	[BOOT_BT_ENABLE] = "bt_enable",
+	[BOOT_NVS] = "nvs",
+	[BOOT_NDEF] = "ndef",
+	[BOOT_TAPPABLE] = "tappable",
+	[BOOT_JOURNAL] = "journal",
+	[BOOT_BT_READY] = "bt_ready",
+	[BOOT_ADVERTISING] = "advertising",
+};
+
+static uint32_t phase_us[BOOT_PHASE_COUNT];
+static atomic_t reached;
+
+#define BOOT_MILESTONES (BIT(BOOT_TAPPABLE) | BIT(BOOT_ADVERTISING))
+
+void boot_profile_mark(enum boot_phase phase)
+{
+	atomic_val_t prev;
+
+	phase_us[phase] = k_cyc_to_us_floor32(k_cycle_get_32());
+	prev = atomic_or(&reached, BIT(phase));
+
+	if ((prev & BOOT_MILESTONES) != BOOT_MILESTONES &&
+	    ((prev | BIT(phase)) & BOOT_MILESTONES) == BOOT_MILESTONES) {
+		boot_profile_print();
+	}
+}
+
+uint32_t boot_profile_get(enum boot_phase phase)
+{
+	return atomic_test_bit(&reached, phase) ? phase_us[phase] : 0;
+}
+
+void boot_profile_print(void)
+{
+	printk("Boot profile (us since kernel start):");
+	for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+		printk(" %s=%u", phase_name[i], boot_profile_get(i));
+	}
+	printk("\n");
+}
+
+/** @} */
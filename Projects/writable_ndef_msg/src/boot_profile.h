@@ -0,0 +1,58 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _BOOT_PROFILE_H__
+#define _BOOT_PROFILE_H__
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_boot_profile boot_profile.h
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Boot phase timestamps for the NFC activity checkpoint.
+ */
+
+#include <zephyr/types.h>
+
+/** Boot phases, in the order they are normally reached. */
+enum boot_phase {
+	BOOT_MAIN,          /**< main() entered. */
+	BOOT_BOARD,         /**< Buttons and LEDs initialized. */
+	BOOT_BT_ENABLE,     /**< bt_enable() issued. */
+	BOOT_NVS,           /**< NVS mounted. */
+	BOOT_NDEF,          /**< NDEF message loaded. */
+	BOOT_TAPPABLE,      /**< NFC emulation started. */
+	BOOT_JOURNAL,       /**< Tap journal mounted. */
+	BOOT_BT_READY,      /**< Bluetooth initialized. */
+	BOOT_ADVERTISING,   /**< Advertising started. */
+	BOOT_PHASE_COUNT,
+};
+
+/**
+ * @brief   Function for recording that a boot phase has been reached.
+ *
+ * @details The profile is printed once both @ref BOOT_TAPPABLE and
+ * @ref BOOT_ADVERTISING have been recorded. Safe to call from any thread.
+ *
+ * @param phase Boot phase.
+ */
+void boot_profile_mark(enum boot_phase phase);
+
+/**
+ * @brief   Function for reading the time a boot phase was reached.
+ *
+ * @param phase Boot phase.
+ *
+ * @return Microseconds since kernel start, 0 if not reached yet.
+ */
+uint32_t boot_profile_get(enum boot_phase phase);
+
+/**
+ * @brief   Function for printing the boot profile.
+ */
+void boot_profile_print(void);
+
+/** @} */
+
+#endif /* _BOOT_PROFILE_H__ */
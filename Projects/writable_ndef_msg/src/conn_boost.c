@@ -0,0 +1,249 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @ingroup nfc_writable_ndef_msg_example_conn_boost conn_boost.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Connection interval boost on NFC field detection.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include "conn_boost.h"
+
+#if defined(CONFIG_CHECKPOINT_CONN_BOOST)
+
+/* Both sets keep the interval, so a boost is a latency change only and
+ * the notifications queued meanwhile still leave at the next event.
+ */
+static const struct bt_le_conn_param fast_param = {
+	.interval_min = CONFIG_CHECKPOINT_CONN_BOOST_INTERVAL,
+	.interval_max = CONFIG_CHECKPOINT_CONN_BOOST_INTERVAL,
+	.latency = 0,
+	.timeout = CONFIG_CHECKPOINT_CONN_BOOST_TIMEOUT,
+};
+
+static const struct bt_le_conn_param slow_param = {
+	.interval_min = CONFIG_CHECKPOINT_CONN_BOOST_INTERVAL,
+	.interval_max = CONFIG_CHECKPOINT_CONN_BOOST_INTERVAL,
+	.latency = CONFIG_CHECKPOINT_CONN_BOOST_IDLE_LATENCY,
+	.timeout = CONFIG_CHECKPOINT_CONN_BOOST_TIMEOUT,
+};
+
+BUILD_ASSERT(CONFIG_CHECKPOINT_CONN_BOOST_TIMEOUT * 10 >
+	     2 * (1 + CONFIG_CHECKPOINT_CONN_BOOST_IDLE_LATENCY) *
+	     CONFIG_CHECKPOINT_CONN_BOOST_INTERVAL * 5 / 4,
+	     "Supervision timeout too short for the idle latency");
+
+static struct conn_boost_stats stats;
+static bool boosted;
+static bool sync_open;
+static uint32_t sync_count;
+static int64_t sync_last;
+
+static void param_request(struct bt_conn *conn, void *user_data)
+{
+	const struct bt_le_conn_param *param = user_data;
+	struct bt_conn_info info;
+	int err;
+
+	if (bt_conn_get_info(conn, &info) || info.role != BT_CONN_ROLE_PERIPHERAL ||
+	    info.state != BT_CONN_STATE_CONNECTED ||
+	    (info.le.interval == param->interval_max &&
+	     info.le.latency == param->latency)) {
+		return;
+	}
+
+	err = bt_conn_le_param_update(conn, param);
+	if (err) {
+		stats.failures++;
+		return;
+	}
+
+	if (param == &fast_param) {
+		stats.boosts++;
+	} else {
+		stats.relaxes++;
+	}
+}
+
+static void relax_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	boosted = false;
+	if (!sync_open) {
+		bt_conn_foreach(BT_CONN_TYPE_LE, param_request,
+				(void *)&slow_param);
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(relax_work, relax_handler);
+
+static void boost_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	/* Links that connected since the last field are boosted too. */
+	boosted = true;
+	bt_conn_foreach(BT_CONN_TYPE_LE, param_request, (void *)&fast_param);
+	k_work_reschedule(&relax_work, K_MSEC(CONFIG_CHECKPOINT_CONN_BOOST_HOLD_MS));
+}
+
+static K_WORK_DEFINE(boost_work, boost_handler);
+
+static void sync_close_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	sync_open = false;
+	if (!boosted) {
+		bt_conn_foreach(BT_CONN_TYPE_LE, param_request,
+				(void *)&slow_param);
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(sync_close_work, sync_close_handler);
+
+static void sync_open_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	sync_open = true;
+	stats.sync_windows++;
+	bt_conn_foreach(BT_CONN_TYPE_LE, param_request, (void *)&fast_param);
+
+	/* Closed by the sample, or after the lead time past the expected one
+	 * if the central skipped it.
+	 */
+	k_work_reschedule(&sync_close_work,
+			  K_MSEC(2 * CONFIG_CHECKPOINT_CONN_BOOST_SYNC_LEAD_MS));
+}
+
+static K_WORK_DELAYABLE_DEFINE(sync_open_work, sync_open_handler);
+
+/* The central writes its clock every few seconds at its own pace, the
+ * window opens one lead time before the next write is expected.
+ */
+static void sync_handler(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+	int64_t period = now - sync_last;
+
+	ARG_UNUSED(work);
+
+	/* The central writes to every link in one go, count a round once. */
+	if (period < CONFIG_CHECKPOINT_CONN_BOOST_SYNC_LEAD_MS) {
+		return;
+	}
+	sync_last = now;
+
+	if (sync_open) {
+		/* Other links hear the same round within an interval. */
+		k_work_reschedule(&sync_close_work,
+				  K_MSEC(CONFIG_CHECKPOINT_CONN_BOOST_SYNC_LEAD_MS));
+	}
+
+	if (++sync_count % CONFIG_CHECKPOINT_CONN_BOOST_SYNC_EVERY == 0 &&
+	    period > 2 * CONFIG_CHECKPOINT_CONN_BOOST_SYNC_LEAD_MS) {
+		k_work_reschedule(&sync_open_work,
+				  K_MSEC(period -
+					 CONFIG_CHECKPOINT_CONN_BOOST_SYNC_LEAD_MS));
+	}
+}
+
+static K_WORK_DEFINE(sync_work, sync_handler);
+
+void conn_boost_field_on(void)
+{
+	k_work_submit(&boost_work);
+}
+
+void conn_boost_time_sync(void)
+{
+	k_work_submit(&sync_work);
+}
+
+void conn_boost_stats_get(struct conn_boost_stats *out)
+{
+	*out = stats;
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		return;
+	}
+
+	/* Service discovery runs at the central's initial parameters, move
+	 * to the idle latency once the link has been quiet for the hold time.
+	 */
+	if (!boosted) {
+		k_work_reschedule(&relax_work,
+				  K_MSEC(CONFIG_CHECKPOINT_CONN_BOOST_HOLD_MS));
+	}
+}
+
+BT_CONN_CB_DEFINE(conn_boost_conn_callbacks) = {
+	.connected = connected,
+};
+
+#if defined(CONFIG_CHECKPOINT_SHELL)
+static void interval_print(struct bt_conn *conn, void *user_data)
+{
+	const struct shell *sh = user_data;
+	char addr[BT_ADDR_LE_STR_LEN];
+	struct bt_conn_info info;
+
+	if (bt_conn_get_info(conn, &info)) {
+		return;
+	}
+
+	bt_addr_le_to_str(info.le.dst, addr, sizeof(addr));
+	shell_print(sh, "%s interval %u.%02u ms latency %u timeout %u ms",
+		    addr, info.le.interval * 5 / 4, (info.le.interval * 125) % 100,
+		    info.le.latency, info.le.timeout * 10);
+}
+
+static int cmd_conn(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "%s, boosts %u relaxes %u failed %u sync windows %u",
+		    boosted ? "boosted" : (sync_open ? "sync window" : "idle"),
+		    stats.boosts, stats.relaxes, stats.failures,
+		    stats.sync_windows);
+	bt_conn_foreach(BT_CONN_TYPE_LE, interval_print, (void *)sh);
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((checkpoint), conn, NULL,
+		 "Connection intervals and boost counters", cmd_conn, 1, 0);
+#endif /* CONFIG_CHECKPOINT_SHELL */
+
+#else
+
+void conn_boost_field_on(void)
+{
+}
+
+void conn_boost_time_sync(void)
+{
+}
+
+void conn_boost_stats_get(struct conn_boost_stats *out)
+{
+	*out = (struct conn_boost_stats){ 0 };
+}
+
+#endif /* CONFIG_CHECKPOINT_CONN_BOOST */
+
+/** @} */
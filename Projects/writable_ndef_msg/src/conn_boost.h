@@ -0,0 +1,65 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _CONN_BOOST_H__
+#define _CONN_BOOST_H__
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_conn_boost conn_boost.h
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Connection interval boost on NFC field detection.
+ *
+ * Links keep a short connection interval and idle on peripheral latency.
+ * The checkpoint wakes at the next connection event whenever it has data,
+ * so a tap notification never waits for more than one interval; latency
+ * only delays what the central sends. An NFC field drops the latency to
+ * zero, so the acknowledgements and category writes that follow a tap
+ * are heard at the next connection event too.
+ *
+ * Time sync writes from the central are delayed by the latency as well,
+ * which makes the central's clock look late. Every few samples the
+ * latency is dropped to zero around the next expected one, so the
+ * least delayed sample that time_sync.c keeps was late by one interval
+ * at most.
+ */
+
+#include <zephyr/types.h>
+
+/** Connection interval boost counters. */
+struct conn_boost_stats {
+	uint32_t boosts;       /**< Zero latency requests. */
+	uint32_t relaxes;      /**< Idle latency requests. */
+	uint32_t failures;     /**< Requests rejected by the stack. */
+	uint32_t sync_windows; /**< Zero latency windows for a time sync. */
+};
+
+/**
+ * @brief   Function for reporting NFC field activity.
+ *
+ * @details Safe to call from any context, the parameter update requests
+ * are made from the system work queue.
+ */
+void conn_boost_field_on(void);
+
+/**
+ * @brief   Function for reporting a time sync sample from the central.
+ *
+ * @details Safe to call from any context. Every
+ * CONFIG_CHECKPOINT_CONN_BOOST_SYNC_EVERY samples, the latency is dropped
+ * to zero around the next expected one.
+ */
+void conn_boost_time_sync(void);
+
+/**
+ * @brief   Function for reading the boost counters.
+ *
+ * @param stats Pointer filled with the counters.
+ */
+void conn_boost_stats_get(struct conn_boost_stats *stats);
+
+/** @} */
+
+#endif /* _CONN_BOOST_H__ */
@@ -0,0 +1,227 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_diag_shell diag_shell.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief "checkpoint" shell commands for field diagnostics.
+ *
+ * Other modules add their own subcommands with SHELL_SUBCMD_ADD().
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/bluetooth/conn.h>
+#include <stdlib.h>
+
+#include "ndef_file_m.h"
+#include "tap_journal.h"
+#include "notify_queue.h"
+#include "boot_profile.h"
+
+#if defined(CONFIG_CHECKPOINT_SHELL)
+
+struct threads_ctx {
+	const struct shell *sh;
+	uint64_t total_cycles;
+};
+
+static void thread_print(const struct k_thread *cthread, void *user_data)
+{
+	struct k_thread *thread = (struct k_thread *)cthread;
+	struct threads_ctx *ctx = user_data;
+	k_thread_runtime_stats_t rt;
+	size_t unused = 0;
+	const char *name = k_thread_name_get(thread);
+	uint32_t permille = 0;
+
+	if (k_thread_runtime_stats_get(thread, &rt) == 0 && ctx->total_cycles) {
+		permille = (rt.execution_cycles * 1000) / ctx->total_cycles;
+	}
+	(void)k_thread_stack_space_get(thread, &unused);
+
+	shell_print(ctx->sh, "%-16s %4d %10llu %3u.%u%% %5u/%u",
+		    name ? name : "?", thread->base.prio,
+		    k_cyc_to_us_floor64(rt.execution_cycles),
+		    permille / 10, permille % 10,
+		    thread->stack_info.size - unused,
+		    thread->stack_info.size);
+}
+
+static int cmd_threads(const struct shell *sh, size_t argc, char **argv)
+{
+	struct threads_ctx ctx = { .sh = sh };
+	k_thread_runtime_stats_t all;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	if (k_thread_runtime_stats_all_get(&all) == 0) {
+		ctx.total_cycles = all.execution_cycles;
+	}
+
+	shell_print(sh, "%-16s %4s %10s %6s %s", "thread", "prio", "run [us]",
+		    "cpu", "stack used/size");
+	k_thread_foreach_unlocked(thread_print, &ctx);
+
+	return 0;
+}
+
+static int cmd_bufs(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "%-24s %s", "pool", "in use/count");
+	STRUCT_SECTION_FOREACH(net_buf_pool, pool) {
+		int avail = atomic_get(&pool->avail_count);
+
+		shell_print(sh, "%-24s %u/%u", pool->name,
+			    pool->buf_count - avail, pool->buf_count);
+	}
+
+	return 0;
+}
+
+static void conn_print(struct bt_conn *conn, void *user_data)
+{
+	const struct shell *sh = user_data;
+	struct notify_queue_stats st;
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	if (notify_queue_stats_get(conn, &st)) {
+		return;
+	}
+
+	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	shell_print(sh, "%s queued %u in-flight %u sent %u dropped %u "
+		    "retries %u journal %u", addr, st.queued, st.in_flight,
+		    st.sent, st.dropped, st.retries, st.journal);
+}
+
+static int cmd_notify(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, conn_print, (void *)sh);
+
+	return 0;
+}
+
+static int cmd_journal(const struct shell *sh, size_t argc, char **argv)
+{
+	struct tap_journal_stats st;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	tap_journal_stats_get(&st);
+	shell_print(sh, "next seq %u acked %u appended %u dropped %u "
+		    "flushes %u page erases %u", st.next_seq, st.acked_seq,
+		    st.appended, st.dropped, st.flushes, st.page_erases);
+
+	return 0;
+}
+
+static int cmd_storage(const struct shell *sh, size_t argc, char **argv)
+{
+	struct ndef_file_stats st;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	ndef_file_stats_get(&st);
+	shell_print(sh, "writes %u worst %u us, gc idle %u inline %u worst %u us, "
+		    "free %u B", st.writes, st.write_worst_us, st.idle_gc,
+		    st.inline_gc, st.gc_worst_us, st.free_bytes);
+	shell_print(sh, "mount %u us with %u B free", st.mount_us,
+		    st.mount_free);
+
+	return 0;
+}
+
+static void bench_print(const struct shell *sh, const char *name,
+			const struct ndef_file_bench_stat *st)
+{
+	shell_print(sh, "bench,%s,%u,%u,%u,%u,%u", name, st->count, st->min_us,
+		    st->count ? st->total_us / st->count : 0, st->max_us,
+		    st->bytes);
+}
+
+/* One CSV line per operation, so host scripts can diff runs. */
+static int cmd_bench(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char *const encode_name[NDEF_FILE_CATEGORIES] = {
+		"encode0", "encode1", "encode2", "encode3",
+	};
+	struct ndef_file_bench bench;
+	struct ndef_file_stats st;
+	uint32_t rounds = 16;
+	int err;
+
+	if (argc > 1) {
+		rounds = strtoul(argv[1], NULL, 0);
+		if (!rounds) {
+			shell_error(sh, "Invalid round count");
+			return -EINVAL;
+		}
+	}
+
+	err = ndef_file_bench_run(rounds, &bench);
+	if (err) {
+		shell_error(sh, "Storage benchmark failed (err %d)", err);
+		return err;
+	}
+
+	ndef_file_stats_get(&st);
+	shell_print(sh, "bench,name,count,min_us,mean_us,max_us,bytes");
+	shell_print(sh, "bench,mount,1,%u,%u,%u,%u", st.mount_us, st.mount_us,
+		    st.mount_us, st.mount_free);
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		bench_print(sh, encode_name[i], &bench.encode[i]);
+	}
+	bench_print(sh, "nvs_write", &bench.write);
+	bench_print(sh, "nvs_read", &bench.read);
+
+	return 0;
+}
+
+static int cmd_boot(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	boot_profile_print();
+
+	return 0;
+}
+
+SHELL_SUBCMD_SET_CREATE(checkpoint_cmds, (checkpoint));
+SHELL_CMD_REGISTER(checkpoint, &checkpoint_cmds, "NFC checkpoint diagnostics",
+		   NULL);
+
+SHELL_SUBCMD_ADD((checkpoint), threads, NULL,
+		 "Thread run time, CPU share and stack high-water mark",
+		 cmd_threads, 1, 0);
+SHELL_SUBCMD_ADD((checkpoint), bufs, NULL, "Buffer pool occupancy",
+		 cmd_bufs, 1, 0);
+SHELL_SUBCMD_ADD((checkpoint), notify, NULL,
+		 "Notification queue counters per connection", cmd_notify, 1, 0);
+SHELL_SUBCMD_ADD((checkpoint), journal, NULL, "Tap journal counters",
+		 cmd_journal, 1, 0);
+SHELL_SUBCMD_ADD((checkpoint), storage, NULL, "NVS write and GC counters",
+		 cmd_storage, 1, 0);
+SHELL_SUBCMD_ADD((checkpoint), bench, NULL,
+		 "Storage benchmark as CSV: bench [rounds]", cmd_bench, 1, 1);
+SHELL_SUBCMD_ADD((checkpoint), boot, NULL, "Boot phase timestamps",
+		 cmd_boot, 1, 0);
+
+#endif /* CONFIG_CHECKPOINT_SHELL */
+
+/** @} */
@@ -0,0 +1,213 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @ingroup nfc_writable_ndef_msg_example_energy energy.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Energy accounting of the checkpoint.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/irq.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/shell/shell.h>
+
+#if defined(CONFIG_MPSL)
+#include <mpsl_radio_notification.h>
+#endif
+
+#include "energy.h"
+
+#if defined(CONFIG_CHECKPOINT_ENERGY)
+
+/* Free software interrupt for the radio notification, the MPSL uses
+ * EGU0 and EGU5.
+ */
+#define RADIO_NOTIF_IRQN	SWI3_EGU3_IRQn
+#define RADIO_NOTIF_PRIO	5
+/* The active notification comes this long before the radio starts. */
+#define RADIO_NOTIF_DISTANCE_US	200
+
+static struct k_spinlock lock;
+static struct energy_stats stats;
+static uint64_t radio_cycles;
+static uint32_t radio_start;
+static bool radio_active;
+static uint32_t field_start;
+static bool field_on;
+
+#if defined(CONFIG_MPSL)
+/* Alternates between before-active and after-inactive notifications. */
+static void radio_notif_isr(const void *arg)
+{
+	uint32_t now = k_cycle_get_32();
+
+	ARG_UNUSED(arg);
+
+	if (!radio_active) {
+		radio_start = now;
+		stats.radio_events++;
+	} else {
+		radio_cycles += now - radio_start;
+	}
+	radio_active = !radio_active;
+}
+#endif
+
+/* Key=value pairs, parsed by Projects/tools/battery_life.py. */
+#define ENERGY_FMT "energy uptime_ms=%u cpu_ms=%u radio_ms=%u " \
+	"radio_events=%u nfc_fields=%u nfc_field_ms=%u taps=%u " \
+	"notifications=%u"
+#define ENERGY_ARGS(_st) (_st).uptime_ms, (_st).cpu_ms, (_st).radio_ms, \
+	(_st).radio_events, (_st).nfc_fields, (_st).nfc_field_ms, \
+	(_st).taps, (_st).notifications
+
+#if CONFIG_CHECKPOINT_ENERGY_REPORT_S > 0
+static void report_handler(struct k_work *work)
+{
+	struct energy_stats st;
+
+	energy_stats_get(&st);
+	printk(ENERGY_FMT "\n", ENERGY_ARGS(st));
+
+	k_work_reschedule(k_work_delayable_from_work(work),
+			  K_SECONDS(CONFIG_CHECKPOINT_ENERGY_REPORT_S));
+}
+
+static K_WORK_DELAYABLE_DEFINE(report_work, report_handler);
+#endif
+
+int energy_init(void)
+{
+#if CONFIG_CHECKPOINT_ENERGY_REPORT_S > 0
+	k_work_reschedule(&report_work,
+			  K_SECONDS(CONFIG_CHECKPOINT_ENERGY_REPORT_S));
+#endif
+
+#if defined(CONFIG_MPSL)
+	int32_t err;
+
+	IRQ_CONNECT(RADIO_NOTIF_IRQN, RADIO_NOTIF_PRIO, radio_notif_isr, NULL, 0);
+	irq_enable(RADIO_NOTIF_IRQN);
+
+	err = mpsl_radio_notification_cfg_set(
+		MPSL_RADIO_NOTIFICATION_TYPE_INT_ON_BOTH,
+		MPSL_RADIO_NOTIFICATION_DISTANCE_200US, RADIO_NOTIF_IRQN);
+	if (err) {
+		printk("Radio notification unavailable (err %d)\n", err);
+		return -EIO;
+	}
+
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+void energy_nfc_field(bool on, uint32_t timestamp)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (on && !field_on) {
+		field_start = timestamp;
+		stats.nfc_fields++;
+	} else if (!on && field_on) {
+		stats.nfc_field_ms += timestamp - field_start;
+	}
+	field_on = on;
+
+	k_spin_unlock(&lock, key);
+}
+
+void energy_tap(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	stats.taps++;
+	k_spin_unlock(&lock, key);
+}
+
+void energy_notify_sent(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	stats.notifications++;
+	k_spin_unlock(&lock, key);
+}
+
+void energy_stats_get(struct energy_stats *out)
+{
+	k_thread_runtime_stats_t rt;
+	uint64_t radio_us;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+	*out = stats;
+	radio_us = k_cyc_to_us_floor64(radio_cycles);
+	if (field_on) {
+		out->nfc_field_ms += k_uptime_get_32() - field_start;
+	}
+	k_spin_unlock(&lock, key);
+
+	radio_us -= MIN(radio_us, (uint64_t)out->radio_events *
+			RADIO_NOTIF_DISTANCE_US);
+	out->radio_ms = radio_us / 1000;
+
+	out->uptime_ms = k_uptime_get_32();
+	if (k_thread_runtime_stats_all_get(&rt) == 0) {
+		out->cpu_ms = k_cyc_to_ms_floor64(rt.execution_cycles -
+						  rt.idle_cycles);
+	}
+}
+
+#if defined(CONFIG_CHECKPOINT_SHELL)
+static int cmd_energy(const struct shell *sh, size_t argc, char **argv)
+{
+	struct energy_stats st;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	energy_stats_get(&st);
+	shell_print(sh, ENERGY_FMT, ENERGY_ARGS(st));
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((checkpoint), energy, NULL,
+		 "Radio and CPU active time and wake-up events", cmd_energy,
+		 1, 0);
+#endif /* CONFIG_CHECKPOINT_SHELL */
+
+#else
+
+int energy_init(void)
+{
+	return 0;
+}
+
+void energy_nfc_field(bool on, uint32_t timestamp)
+{
+	ARG_UNUSED(on);
+	ARG_UNUSED(timestamp);
+}
+
+void energy_tap(void)
+{
+}
+
+void energy_notify_sent(void)
+{
+}
+
+void energy_stats_get(struct energy_stats *out)
+{
+	*out = (struct energy_stats){ 0 };
+}
+
+#endif /* CONFIG_CHECKPOINT_ENERGY */
+
+/** @} */
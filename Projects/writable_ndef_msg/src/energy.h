@@ -0,0 +1,66 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _ENERGY_H__
+#define _ENERGY_H__
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_energy energy.h
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Energy accounting of the checkpoint.
+ *
+ * Accumulates the time the radio and the CPU are active, and counts the
+ * events that wake them, so a battery life can be projected from a field
+ * capture. Radio time comes from the MPSL radio notification, CPU time
+ * from the run time of every thread but the idle one.
+ */
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+
+/** Energy counters since boot. */
+struct energy_stats {
+	uint32_t uptime_ms;
+	uint32_t cpu_ms;       /**< Time outside the idle thread. */
+	uint32_t radio_ms;     /**< Radio active, advertising included. */
+	uint32_t radio_events; /**< Radio activity periods. */
+	uint32_t nfc_fields;   /**< NFC fields detected. */
+	uint32_t nfc_field_ms; /**< Time an NFC field was present. */
+	uint32_t taps;         /**< Taps reported. */
+	uint32_t notifications; /**< Notifications sent. */
+};
+
+/**
+ * @brief   Function for starting the radio activity accounting.
+ *
+ * @return 0 on success, error code otherwise.
+ */
+int energy_init(void);
+
+/**
+ * @brief   Function for reporting an NFC field change.
+ *
+ * @param on true when the field appeared.
+ * @param timestamp Uptime of the change in milliseconds.
+ */
+void energy_nfc_field(bool on, uint32_t timestamp);
+
+/** @brief Function for counting a reported tap. */
+void energy_tap(void);
+
+/** @brief Function for counting a sent notification, from any context. */
+void energy_notify_sent(void);
+
+/**
+ * @brief   Function for reading the energy counters.
+ *
+ * @param stats Pointer filled with the counters.
+ */
+void energy_stats_get(struct energy_stats *stats);
+
+/** @} */
+
+#endif /* _ENERGY_H__ */
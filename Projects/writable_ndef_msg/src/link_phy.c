@@ -0,0 +1,525 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @ingroup nfc_writable_ndef_msg_example_link_phy link_phy.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Long range advertising and PHY selection per link.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <errno.h>
+
+#if defined(CONFIG_CHECKPOINT_PHY_ADAPT)
+#include <sdc_hci_vs.h>
+#endif
+
+#include "link_phy.h"
+
+#if defined(CONFIG_CHECKPOINT_LONG_RANGE) || defined(CONFIG_CHECKPOINT_PHY_ADAPT)
+
+/** Delay before retrying a failed start of the Coded advertising set. */
+#define ADV_RETRY_MS 1000
+
+/** Margin above a threshold before moving back to the faster PHY (dB). */
+#define PHY_HYSTERESIS_DB 5
+
+/** Fewer packets in an evaluation period give no usable error rate. */
+#define PER_MIN_PACKETS 20
+
+/** Per-link state, indexed by bt_conn_index(). */
+struct phy_link {
+	struct bt_conn *conn;
+	uint16_t handle;
+	uint8_t phy;          /**< Current TX PHY, BT_GAP_LE_PHY_*. */
+	uint8_t requested;    /**< PHY of the last request, 0 if none. */
+	uint8_t refused;      /**< Bits of PHYs the central kept off. */
+	bool rssi_valid;
+	int16_t rssi_x16;     /**< Smoothed RSSI in 1/16 dBm. */
+	int8_t per;           /**< Last packet error rate (%), -1 unknown. */
+	atomic_t rx_packets;  /**< Packets received since the last evaluation. */
+	atomic_t rx_errors;   /**< Of which failed the CRC or were missed. */
+};
+
+static struct phy_link links[CONFIG_BT_MAX_CONN];
+static struct k_spinlock lock;
+static struct link_phy_stats stats;
+
+static const char *phy_str(uint8_t phy)
+{
+	switch (phy) {
+	case BT_GAP_LE_PHY_1M:
+		return "1M";
+	case BT_GAP_LE_PHY_2M:
+		return "2M";
+	case BT_GAP_LE_PHY_CODED:
+		return "Coded";
+	default:
+		return "?";
+	}
+}
+
+#if defined(CONFIG_CHECKPOINT_LONG_RANGE)
+static struct bt_le_ext_adv *coded_adv;
+
+static void adv_handler(struct k_work *work)
+{
+	int err;
+
+	err = bt_le_ext_adv_start(coded_adv, BT_LE_EXT_ADV_START_DEFAULT);
+	if (!err || err == -EALREADY) {
+		return;
+	}
+
+	stats.adv_errors++;
+	/* Without a free connection object the set restarts once one is
+	 * recycled, anything else is retried.
+	 */
+	if (err != -ENOMEM) {
+		printk("Coded advertising failed to start (err %d)\n", err);
+		k_work_schedule(k_work_delayable_from_work(work),
+				K_MSEC(ADV_RETRY_MS));
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(adv_work, adv_handler);
+
+static void adv_connected(struct bt_le_ext_adv *instance,
+			  struct bt_le_ext_adv_connected_info *info)
+{
+	ARG_UNUSED(instance);
+	ARG_UNUSED(info);
+
+	/* The set stops on a connection, keep it going for the others. */
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+}
+
+static const struct bt_le_ext_adv_cb adv_cb = {
+	.connected = adv_connected,
+};
+
+static int coded_adv_init(const struct bt_data *ad, size_t ad_len)
+{
+	int err;
+
+	err = bt_le_ext_adv_create(BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE |
+						   BT_LE_ADV_OPT_EXT_ADV |
+						   BT_LE_ADV_OPT_CODED,
+						   BT_GAP_ADV_FAST_INT_MIN_2,
+						   BT_GAP_ADV_FAST_INT_MAX_2,
+						   NULL),
+				   &adv_cb, &coded_adv);
+	if (err) {
+		printk("Coded advertising set failed (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_ext_adv_set_data(coded_adv, ad, ad_len, NULL, 0);
+	if (err) {
+		printk("Coded advertising data failed (err %d)\n", err);
+		return err;
+	}
+
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+
+	return 0;
+}
+#endif /* CONFIG_CHECKPOINT_LONG_RANGE */
+
+#if defined(CONFIG_CHECKPOINT_PHY_ADAPT)
+static bool qos_report(struct net_buf_simple *buf)
+{
+	const sdc_hci_subevent_vs_qos_conn_event_report_t *evt;
+	uint16_t handle;
+
+	if (buf->len < 1 + sizeof(*evt) ||
+	    buf->data[0] != SDC_HCI_SUBEVENT_VS_QOS_CONN_EVENT_REPORT) {
+		return false;
+	}
+
+	evt = (const void *)&buf->data[1];
+	handle = sys_le16_to_cpu(evt->conn_handle);
+
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		if (!links[i].conn || links[i].handle != handle) {
+			continue;
+		}
+		/* rx_packet_count counts every packet received in the event,
+		 * crc_error_count the part of them that failed the CRC. A
+		 * missed connection event counts as one lost packet.
+		 */
+		atomic_add(&links[i].rx_packets,
+			   evt->rx_packet_count + (evt->rx_timeout ? 1 : 0));
+		atomic_add(&links[i].rx_errors,
+			   evt->crc_error_count + (evt->rx_timeout ? 1 : 0));
+		break;
+	}
+
+	return true;
+}
+
+static int qos_report_enable(void)
+{
+	sdc_hci_cmd_vs_qos_conn_event_report_enable_t *cp;
+	struct net_buf *buf;
+	int err;
+
+	err = bt_hci_register_vnd_evt_cb(qos_report);
+	if (err) {
+		return err;
+	}
+
+	buf = bt_hci_cmd_create(SDC_HCI_OPCODE_CMD_VS_QOS_CONN_EVENT_REPORT_ENABLE,
+				sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->enable = 1;
+
+	return bt_hci_cmd_send_sync(SDC_HCI_OPCODE_CMD_VS_QOS_CONN_EVENT_REPORT_ENABLE,
+				    buf, NULL);
+}
+
+static int rssi_read(uint16_t handle, int8_t *rssi)
+{
+	struct bt_hci_cp_read_rssi *cp;
+	struct bt_hci_rp_read_rssi *rp;
+	struct net_buf *buf;
+	struct net_buf *rsp = NULL;
+	int err;
+
+	buf = bt_hci_cmd_create(BT_HCI_OP_READ_RSSI, sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle = sys_cpu_to_le16(handle);
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_RSSI, buf, &rsp);
+	if (err) {
+		return err;
+	}
+
+	rp = (void *)rsp->data;
+	*rssi = rp->rssi;
+	net_buf_unref(rsp);
+
+	return 0;
+}
+
+/** Next PHY for a link, or its current one to stay. */
+static uint8_t phy_select(const struct phy_link *link)
+{
+	const bool coded = IS_ENABLED(CONFIG_CHECKPOINT_LONG_RANGE) &&
+			   !(link->refused & BT_GAP_LE_PHY_CODED);
+	const bool fast = !(link->refused & BT_GAP_LE_PHY_2M);
+	const bool lossy = link->per >= CONFIG_CHECKPOINT_PHY_PER_HIGH;
+	const bool clean = link->per >= 0 &&
+			   link->per <= CONFIG_CHECKPOINT_PHY_PER_LOW;
+	const int rssi = link->rssi_x16 / 16;
+
+	if (!link->rssi_valid) {
+		return link->phy;
+	}
+
+	switch (link->phy) {
+	case BT_GAP_LE_PHY_2M:
+		if (lossy || rssi < CONFIG_CHECKPOINT_PHY_RSSI_2M) {
+			return BT_GAP_LE_PHY_1M;
+		}
+		break;
+	case BT_GAP_LE_PHY_1M:
+		if (coded && (lossy || rssi < CONFIG_CHECKPOINT_PHY_RSSI_CODED)) {
+			return BT_GAP_LE_PHY_CODED;
+		}
+		if (fast && clean &&
+		    rssi >= CONFIG_CHECKPOINT_PHY_RSSI_2M + PHY_HYSTERESIS_DB) {
+			return BT_GAP_LE_PHY_2M;
+		}
+		break;
+	case BT_GAP_LE_PHY_CODED:
+		if (clean &&
+		    rssi >= CONFIG_CHECKPOINT_PHY_RSSI_CODED + PHY_HYSTERESIS_DB) {
+			return BT_GAP_LE_PHY_1M;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return link->phy;
+}
+
+static void phy_request(struct bt_conn *conn, uint8_t phy)
+{
+	struct bt_conn_le_phy_param param = {
+		.options = phy == BT_GAP_LE_PHY_CODED ?
+			   BT_CONN_LE_PHY_OPT_CODED_S8 :
+			   BT_CONN_LE_PHY_OPT_NONE,
+		.pref_tx_phy = phy,
+		.pref_rx_phy = phy,
+	};
+	int err;
+
+	err = bt_conn_le_phy_update(conn, &param);
+	if (err) {
+		stats.failures++;
+		return;
+	}
+
+	switch (phy) {
+	case BT_GAP_LE_PHY_2M:
+		stats.to_2m++;
+		break;
+	case BT_GAP_LE_PHY_1M:
+		stats.to_1m++;
+		break;
+	default:
+		stats.to_coded++;
+		break;
+	}
+}
+
+static void link_eval(struct phy_link *link)
+{
+	uint32_t packets = atomic_clear(&link->rx_packets);
+	uint32_t errors = atomic_clear(&link->rx_errors);
+	k_spinlock_key_t key;
+	struct bt_conn *conn;
+	uint8_t next;
+	int8_t rssi;
+	int err;
+
+	err = rssi_read(link->handle, &rssi);
+
+	key = k_spin_lock(&lock);
+	if (!link->conn) {
+		k_spin_unlock(&lock, key);
+		return;
+	}
+
+	if (!err && rssi != BT_HCI_LE_RSSI_NOT_AVAILABLE) {
+		if (link->rssi_valid) {
+			link->rssi_x16 += (rssi * 16 - link->rssi_x16) / 4;
+		} else {
+			link->rssi_x16 = rssi * 16;
+			link->rssi_valid = true;
+		}
+	}
+	link->per = packets >= PER_MIN_PACKETS ? errors * 100 / packets : -1;
+
+	/* A request that did not change the PHY was refused by the
+	 * central, do not ask for that PHY again on this link.
+	 */
+	if (link->requested && link->requested != link->phy) {
+		link->refused |= link->requested;
+	}
+	link->requested = 0;
+
+	next = phy_select(link);
+	if (next != link->phy) {
+		link->requested = next;
+	}
+	conn = bt_conn_ref(link->conn);
+	k_spin_unlock(&lock, key);
+
+	if (next != link->phy) {
+		phy_request(conn, next);
+	}
+	bt_conn_unref(conn);
+}
+
+static void eval_handler(struct k_work *work)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		if (links[i].conn) {
+			link_eval(&links[i]);
+		}
+	}
+
+	k_work_schedule(k_work_delayable_from_work(work),
+			K_MSEC(CONFIG_CHECKPOINT_PHY_EVAL_MS));
+}
+
+static K_WORK_DELAYABLE_DEFINE(eval_work, eval_handler);
+#endif /* CONFIG_CHECKPOINT_PHY_ADAPT */
+
+int link_phy_init(const struct bt_data *ad, size_t ad_len)
+{
+	int err = 0;
+
+	ARG_UNUSED(ad);
+	ARG_UNUSED(ad_len);
+
+#if defined(CONFIG_CHECKPOINT_PHY_ADAPT)
+	err = qos_report_enable();
+	if (err) {
+		printk("Link quality reports unavailable (err %d)\n", err);
+	}
+	k_work_schedule(&eval_work, K_MSEC(CONFIG_CHECKPOINT_PHY_EVAL_MS));
+#endif
+
+#if defined(CONFIG_CHECKPOINT_LONG_RANGE)
+	err = coded_adv_init(ad, ad_len);
+#endif
+
+	return err;
+}
+
+void link_phy_stats_get(struct link_phy_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = stats;
+	k_spin_unlock(&lock, key);
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct phy_link *link = &links[bt_conn_index(conn)];
+	struct bt_conn_info info;
+	k_spinlock_key_t key;
+	uint16_t handle;
+
+	if (err || bt_conn_get_info(conn, &info) ||
+	    bt_hci_get_conn_handle(conn, &handle)) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	link->handle = handle;
+	link->phy = info.le.phy->tx_phy;
+	link->requested = 0;
+	link->refused = 0;
+	link->rssi_valid = false;
+	link->per = -1;
+	atomic_clear(&link->rx_packets);
+	atomic_clear(&link->rx_errors);
+	link->conn = bt_conn_ref(conn);
+	k_spin_unlock(&lock, key);
+
+	printk("Connected on the %s PHY\n", phy_str(link->phy));
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct phy_link *link = &links[bt_conn_index(conn)];
+	k_spinlock_key_t key;
+	struct bt_conn *old;
+
+	ARG_UNUSED(reason);
+
+	key = k_spin_lock(&lock);
+	old = link->conn;
+	link->conn = NULL;
+	k_spin_unlock(&lock, key);
+
+	if (old) {
+		bt_conn_unref(old);
+	}
+}
+
+static void le_phy_updated(struct bt_conn *conn,
+			   struct bt_conn_le_phy_info *param)
+{
+	struct phy_link *link = &links[bt_conn_index(conn)];
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+	if (link->conn == conn) {
+		link->phy = param->tx_phy;
+		stats.updates++;
+	}
+	k_spin_unlock(&lock, key);
+}
+
+#if defined(CONFIG_CHECKPOINT_LONG_RANGE)
+static void recycled(void)
+{
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+}
+#endif
+
+BT_CONN_CB_DEFINE(link_phy_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_phy_updated = le_phy_updated,
+#if defined(CONFIG_CHECKPOINT_LONG_RANGE)
+	.recycled = recycled,
+#endif
+};
+
+#if defined(CONFIG_CHECKPOINT_SHELL)
+static int cmd_phy(const struct shell *sh, size_t argc, char **argv)
+{
+	struct link_phy_stats s;
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	link_phy_stats_get(&s);
+	shell_print(sh, "to 2M %u to 1M %u to Coded %u updates %u failed %u "
+		    "adv errors %u", s.to_2m, s.to_1m, s.to_coded, s.updates,
+		    s.failures, s.adv_errors);
+
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		struct phy_link link;
+		k_spinlock_key_t key = k_spin_lock(&lock);
+
+		link = links[i];
+		if (link.conn) {
+			bt_addr_le_to_str(bt_conn_get_dst(link.conn), addr,
+					  sizeof(addr));
+		}
+		k_spin_unlock(&lock, key);
+
+		if (!link.conn) {
+			continue;
+		}
+		if (link.rssi_valid) {
+			shell_print(sh, "%s %s rssi %d dBm per %d%%", addr,
+				    phy_str(link.phy), link.rssi_x16 / 16,
+				    link.per);
+		} else {
+			shell_print(sh, "%s %s", addr, phy_str(link.phy));
+		}
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((checkpoint), phy, NULL,
+		 "PHY of each link and PHY selection counters", cmd_phy, 1, 0);
+#endif /* CONFIG_CHECKPOINT_SHELL */
+
+#else
+
+int link_phy_init(const struct bt_data *ad, size_t ad_len)
+{
+	ARG_UNUSED(ad);
+	ARG_UNUSED(ad_len);
+
+	return -ENOTSUP;
+}
+
+void link_phy_stats_get(struct link_phy_stats *stats)
+{
+	*stats = (struct link_phy_stats){ 0 };
+}
+
+#endif /* CONFIG_CHECKPOINT_LONG_RANGE || CONFIG_CHECKPOINT_PHY_ADAPT */
+
+/** @} */
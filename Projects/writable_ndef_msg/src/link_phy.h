@@ -0,0 +1,59 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _LINK_PHY_H__
+#define _LINK_PHY_H__
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_link_phy link_phy.h
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Long range advertising and PHY selection per link.
+ *
+ * Checkpoints at the edge of the central's range advertise on the Coded
+ * PHY next to the legacy advertisement. Once connected, each link moves
+ * between the 2M, 1M and Coded PHYs following its smoothed RSSI and the
+ * share of packets received with a CRC error, stepping down quickly on
+ * loss and back up only with a margin.
+ */
+
+#include <stddef.h>
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/bluetooth.h>
+
+/** PHY selection counters. */
+struct link_phy_stats {
+	uint32_t to_2m;      /**< Requests for the 2M PHY. */
+	uint32_t to_1m;      /**< Requests for the 1M PHY. */
+	uint32_t to_coded;   /**< Requests for the Coded PHY. */
+	uint32_t updates;    /**< PHY updates completed by the controller. */
+	uint32_t failures;   /**< Requests rejected by the stack. */
+	uint32_t adv_errors; /**< Failed starts of the Coded advertising set. */
+};
+
+/**
+ * @brief   Function for starting the Coded PHY advertising set and the
+ *          PHY selection.
+ *
+ * @details Call once Bluetooth is enabled. The advertising data must stay
+ * valid as long as the set is used.
+ *
+ * @param ad     Advertising data, as passed to the legacy advertisement.
+ * @param ad_len Number of elements in @p ad.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int link_phy_init(const struct bt_data *ad, size_t ad_len);
+
+/**
+ * @brief   Function for reading the PHY selection counters.
+ *
+ * @param stats Pointer filled with the counters.
+ */
+void link_phy_stats_get(struct link_phy_stats *stats);
+
+/** @} */
+
+#endif /* _LINK_PHY_H__ */
@@ -17,6 +17,8 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/sys/reboot.h>
+#include <zephyr/timing/timing.h>
+#include <zephyr/shell/shell.h>
 #include <stdbool.h>
 #include <nfc_t4t_lib.h>
 
@@ -26,11 +28,21 @@
 #include <dk_buttons_and_leds.h>
 
 #include "ndef_file_m.h"
+#include "tap_journal.h"
+#include "boot_profile.h"
+#include "notify_queue.h"
+#include "time_sync.h"
+#include "conn_boost.h"
+#include "relay.h"
+#include "energy.h"
+#include "warm_restart.h"
+#include "link_phy.h"
 
 #include <zephyr/types.h>
 #include <zephyr/drivers/sensor.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/sys/byteorder.h>
@@ -57,8 +69,6 @@ const char msg3[] = "User Access Quiz";
 const char msg4[] = "User Access Survey";
 const char* const bt_notifs[] = { msg1, msg2, msg3, msg4};
 
-bool notify_scan = false;
-
 // Set up the advertisement data.
 #define DEVICE_NAME "NFC_Proj_18"
 #define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
@@ -78,6 +88,90 @@ static void ccc_changed(const struct bt_gatt_attr *attr,
 	printk("CCC Notifications %s", notif_enabled ? "enabled" : "disabled");
 }
 
+static ssize_t journal_ccc_write(struct bt_conn *conn,
+				 const struct bt_gatt_attr *attr,
+				 uint16_t value)
+{
+	ARG_UNUSED(attr);
+
+	notify_queue_journal_subscribe(conn, value == BT_GATT_CCC_NOTIFY);
+
+	return sizeof(value);
+}
+
+static ssize_t journal_ack_write(struct bt_conn *conn,
+				 const struct bt_gatt_attr *attr,
+				 const void *buf, uint16_t len,
+				 uint16_t offset, uint8_t flags)
+{
+	ARG_UNUSED(conn);
+	ARG_UNUSED(attr);
+	ARG_UNUSED(flags);
+
+	if (offset != 0 || len != sizeof(uint32_t)) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	if (tap_journal_ack(sys_get_le32(buf)) < 0) {
+		printk("Invalid journal acknowledgement\n");
+	}
+
+	return len;
+}
+
+static ssize_t time_sync_write(struct bt_conn *conn,
+			       const struct bt_gatt_attr *attr,
+			       const void *buf, uint16_t len,
+			       uint16_t offset, uint8_t flags)
+{
+	ARG_UNUSED(attr);
+	ARG_UNUSED(flags);
+
+	if (offset != 0 || len != sizeof(uint32_t)) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	time_sync_sample(conn, sys_get_le32(buf));
+	conn_boost_time_sync();
+
+	return len;
+}
+
+/* Wakes the main loop on button and NFC activity. The loop blocks on it
+ * instead of spinning on __WFE() so that lower priority threads, like the
+ * NVS garbage collection queue, get to run while the checkpoint is idle.
+ */
+static K_SEM_DEFINE(main_loop_sem, 0, 1);
+
+/** Category written by a central, applied by the main loop. */
+static atomic_t category_request = ATOMIC_INIT(-1);
+
+static ssize_t category_write(struct bt_conn *conn,
+			      const struct bt_gatt_attr *attr,
+			      const void *buf, uint16_t len,
+			      uint16_t offset, uint8_t flags)
+{
+	uint8_t category;
+
+	ARG_UNUSED(conn);
+	ARG_UNUSED(attr);
+	ARG_UNUSED(flags);
+
+	if (offset != 0 || len != sizeof(category)) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	category = *(const uint8_t *)buf;
+	if (category >= ARRAY_SIZE(bt_notifs)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+
+	atomic_set(&category_request, category);
+	k_sem_give(&main_loop_sem);
+
+	return len;
+}
+
 BT_GATT_SERVICE_DEFINE(lab2_service,
 	BT_GATT_PRIMARY_SERVICE(
 		BT_UUID_DECLARE_128(LAB2_SERVICE_UUID)
@@ -86,50 +180,102 @@ BT_GATT_SERVICE_DEFINE(lab2_service,
 			       BT_GATT_PERM_READ, NULL, NULL, bt_notifs[0]),
 	BT_GATT_CCC(ccc_changed,
 		    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0x0002),
+			       BT_GATT_CHRC_NOTIFY | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+			       BT_GATT_PERM_WRITE, NULL, journal_ack_write, NULL),
+	BT_GATT_CCC_MANAGED(((struct _bt_gatt_ccc[])
+		{BT_GATT_CCC_INITIALIZER(NULL, journal_ccc_write, NULL)}),
+		BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0x0003),
+			       BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+			       BT_GATT_PERM_WRITE, NULL, time_sync_write, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0x0004),
+			       BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+			       BT_GATT_PERM_WRITE, NULL, category_write, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_16(0x0005), BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 );
 
+/* Relayed taps of other checkpoints go out on the relay characteristic. */
+static int relay_deliver(const struct relay_pdu *pdu)
+{
+	return notify_queue_broadcast(&lab2_service.attrs[11], pdu,
+				      sizeof(*pdu));
+}
+
 #define NFC_FIELD_LED		DK_ALL_LEDS_MSK
 #define NFC_WRITE_LED		DK_ALL_LEDS_MSK
 #define NFC_READ_LED		DK_ALL_LEDS_MSK
 
 #define NDEF_RESTORE_BTN_MSK	DK_BTN1_MSK
 
+/* Largest READ BINARY response assumed for phones, short APDU Le. */
+#define T4T_READER_MLE		255
+
 static char url_c0[] = "Check-In";
 static char url_c1[] = "Info";
 static char url_c2[] = "Quiz";
 static char url_c3[] = "Survey";
 
 static char* url_cat[] = {url_c0, url_c1, url_c2, url_c3 };
-static uint8_t ndef_msg_buf[CONFIG_NDEF_FILE_SIZE]; /**< Buffer for NDEF file. */
-
+/** Buffer for NDEF file. Not cleared at boot, a warm restart emulates it
+ * as it was left.
+ */
+static __noinit uint8_t ndef_msg_buf[CONFIG_NDEF_FILE_SIZE];
+static bool ndef_msg_valid; /**< ndef_msg_buf holds an emulated file. */
+
+/* Owner of ndef_msg_buf. The Type 4 Tag library writes phone updates
+ * straight into it, and once the phone has set the new NLEN the main loop
+ * persists it in place, without a copy. A phone starting another update
+ * during the flash write takes the buffer back, and the completed message
+ * is written again.
+ */
 enum {
-	FLASH_WRITE_FINISHED,
-	FLASH_BUF_PREP_STARTED,
-	FLASH_BUF_PREP_FINISHED,
-	FLASH_WRITE_STARTED,
+	NDEF_BUF_IDLE,       /**< Emulated, nothing to persist. */
+	NDEF_BUF_UPDATING,   /**< Phone update in progress (NLEN is zero). */
+	NDEF_BUF_WRITTEN,    /**< Complete update waiting for the flash. */
+	NDEF_BUF_PERSISTING, /**< Main loop writing the buffer to flash. */
 };
-static atomic_t op_flags;
-static uint8_t flash_buf[CONFIG_NDEF_FILE_SIZE]; /**< Buffer for flash update. */
-static uint8_t flash_buf_len; /**< Length of the flash buffer. */
+static atomic_t ndef_buf_state;
+static atomic_t ndef_buf_category; /**< Category the phone wrote to. */
 
-static void flash_buffer_prepare(size_t data_length)
-{
-	if (atomic_cas(&op_flags, FLASH_WRITE_FINISHED,
-			FLASH_BUF_PREP_STARTED)) {
-		flash_buf_len = data_length + NFC_NDEF_FILE_NLEN_FIELD_SIZE;
-		memcpy(flash_buf, ndef_msg_buf, sizeof(flash_buf));
+int url_id = 0;
 
-		atomic_set(&op_flags, FLASH_BUF_PREP_FINISHED);
-	} else {
-		printk("Flash update pending. Discarding new data...\n");
-	}
+static void button_changed(uint32_t button_state, uint32_t has_changed)
+{
+	ARG_UNUSED(button_state);
+	ARG_UNUSED(has_changed);
 
+	k_sem_give(&main_loop_sem);
 }
 
-int url_id = 0;
+/** NFC event recorded by nfc_callback() for the main loop. */
+struct nfc_event {
+	nfc_t4t_event_t event;
+	uint32_t timestamp;   /**< Uptime in milliseconds. */
+	uint32_t data_length;
+	uint8_t category;     /**< Active URL category when it happened. */
+};
+
+static K_MSGQ_DEFINE(nfc_event_q, sizeof(struct nfc_event),
+	      CONFIG_CHECKPOINT_NFC_EVENT_QUEUE_LEN, 4);
+
+/** nfc_callback() execution time, measured with the timing API. */
+static struct {
+	uint32_t count;
+	uint32_t dropped;  /**< Events lost to a full queue. */
+	uint64_t total_ns;
+	uint32_t worst_ns;
+	uint32_t reported_ns;
+} nfc_isr_stats;
 
 /**
  * @brief Callback function for handling NFC events.
+ *
+ * @details Runs in the NFC library's interrupt context while the reader
+ * waits for the APDU response, so it only timestamps the event and queues
+ * it. LEDs, logging and notifications are handled by the main loop.
  */
 static void nfc_callback(void *context,
 			 nfc_t4t_event_t event,
@@ -137,17 +283,100 @@ static void nfc_callback(void *context,
 			 size_t data_length,
 			 uint32_t flags)
 {
+	timing_t start = timing_counter_get();
+	timing_t end;
+	struct nfc_event evt = {
+		.event = event,
+		.timestamp = k_uptime_get_32(),
+		.data_length = data_length,
+		.category = url_id,
+	};
+	uint32_t ns;
+
 	ARG_UNUSED(context);
 	ARG_UNUSED(data);
 	ARG_UNUSED(flags);
 
-	switch (event) {
+	/* Start the connection parameter update right away, the NDEF read
+	 * and its notification follow within a few tens of milliseconds.
+	 */
+	if (event == NFC_T4T_EVENT_FIELD_ON) {
+		conn_boost_field_on();
+	}
+
+	if (event == NFC_T4T_EVENT_NDEF_UPDATED) {
+		atomic_set(&ndef_buf_category, url_id);
+		atomic_set(&ndef_buf_state, data_length ? NDEF_BUF_WRITTEN :
+			   NDEF_BUF_UPDATING);
+	}
+
+	if (k_msgq_put(&nfc_event_q, &evt, K_NO_WAIT) == 0) {
+		k_sem_give(&main_loop_sem);
+	} else {
+		nfc_isr_stats.dropped++;
+	}
+
+	end = timing_counter_get();
+	ns = timing_cycles_to_ns(timing_cycles_get(&start, &end));
+	nfc_isr_stats.count++;
+	nfc_isr_stats.total_ns += ns;
+	nfc_isr_stats.worst_ns = MAX(nfc_isr_stats.worst_ns, ns);
+}
+
+/** Read coalescing state, one tap per field presence. */
+static struct {
+	bool in_field_tap;   /**< A tap was reported during this field. */
+	bool any_tap;        /**< A tap was reported since boot. */
+	uint32_t last_tap;   /**< Uptime of the last reported tap. */
+	uint32_t raw_reads;  /**< NDEF_READ events received. */
+	uint32_t taps;       /**< Taps reported. */
+	uint32_t coalesced;  /**< Reads merged into a tap of the same field. */
+	uint32_t too_soon;   /**< Reads within the minimum re-tap interval. */
+} tap_state;
+
+/* Phones often read the NDEF file several times per tap: only the first
+ * read between FIELD_ON and FIELD_OFF counts, and only if the previous
+ * tap is at least CONFIG_CHECKPOINT_RETAP_MIN_MS old.
+ */
+static bool tap_accept(const struct nfc_event *evt)
+{
+	tap_state.raw_reads++;
+
+	if (tap_state.in_field_tap) {
+		tap_state.coalesced++;
+		return false;
+	}
+
+	if (tap_state.any_tap &&
+	    evt->timestamp - tap_state.last_tap < CONFIG_CHECKPOINT_RETAP_MIN_MS) {
+		tap_state.too_soon++;
+		return false;
+	}
+
+	tap_state.in_field_tap = true;
+	tap_state.any_tap = true;
+	tap_state.last_tap = evt->timestamp;
+	tap_state.taps++;
+
+	return true;
+}
+
+static void nfc_event_process(const struct nfc_event *evt)
+{
+	struct tap_record rec;
+	int centrals;
+
+	switch (evt->event) {
 	case NFC_T4T_EVENT_FIELD_ON:
 		//dk_set_led_on(NFC_FIELD_LED);
 		dk_set_leds( NFC_FIELD_LED );
+		tap_state.in_field_tap = false;
+		energy_nfc_field(true, evt->timestamp);
 		break;
 
 	case NFC_T4T_EVENT_FIELD_OFF:
+		tap_state.in_field_tap = false;
+		energy_nfc_field(false, evt->timestamp);
 		dk_set_leds( DK_NO_LEDS_MSK );
 		dk_set_led_on(url_id==0?DK_LED1:url_id==1?DK_LED2:url_id==2?DK_LED3:DK_LED4);
 		break;
@@ -155,32 +384,158 @@ static void nfc_callback(void *context,
 	case NFC_T4T_EVENT_NDEF_READ:
 		//dk_set_led_on(NFC_READ_LED);
 		dk_set_leds(NFC_READ_LED);
-		printk( "User accessed '%s' portal\n", url_cat[url_id]);
-		notify_scan = true;
+		if (!tap_accept(evt)) {
+			break;
+		}
+		energy_tap();
+		printk( "User accessed '%s' portal\n", url_cat[evt->category]);
+		centrals = notify_queue_broadcast(&lab2_service.attrs[1], (bt_notifs[evt->category]), strlen(bt_notifs[evt->category]));
+		/* Journaled in local time, each central gets it in its own
+		 * time when the record is sent.
+		 */
+		if (tap_journal_append(evt->category, 0, evt->timestamp,
+				       &rec) == 0) {
+			notify_queue_journal_kick();
+			/* Nobody listening, flood it toward a checkpoint that
+			 * has a central.
+			 */
+			if (centrals <= 0) {
+				relay_tap(rec.seq, evt->category, evt->timestamp);
+			}
+		}
 		break;
 
 	case NFC_T4T_EVENT_NDEF_UPDATED:
-		if (data_length > 0) {
+		if (evt->data_length > 0) {
 			//dk_set_led_on(NFC_WRITE_LED);
 			dk_set_leds(NFC_WRITE_LED);
-			flash_buffer_prepare(data_length);
 		}
 		break;
 
 	default:
 		break;
 	}
-	// printk( "%d\n", event );
-	//for (int i=0; i<data_length; i++ )
-	//  printk( "%2x ", data[i]);
-	//printk( "\n" );
+
+	if (nfc_isr_stats.worst_ns > nfc_isr_stats.reported_ns) {
+		nfc_isr_stats.reported_ns = nfc_isr_stats.worst_ns;
+		printk("NFC callback: worst %u ns, mean %u ns over %u events, %u dropped\n",
+		       nfc_isr_stats.worst_ns,
+		       (uint32_t)(nfc_isr_stats.total_ns / nfc_isr_stats.count),
+		       nfc_isr_stats.count, nfc_isr_stats.dropped);
+	}
+}
+
+#if defined(CONFIG_CHECKPOINT_SHELL)
+static int cmd_nfc(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "events %u dropped %u queued %u/%u, callback worst %u ns mean %u ns",
+		    nfc_isr_stats.count, nfc_isr_stats.dropped,
+		    k_msgq_num_used_get(&nfc_event_q),
+		    CONFIG_CHECKPOINT_NFC_EVENT_QUEUE_LEN, nfc_isr_stats.worst_ns,
+		    nfc_isr_stats.count ?
+		    (uint32_t)(nfc_isr_stats.total_ns / nfc_isr_stats.count) : 0);
+	shell_print(sh, "reads %u taps %u coalesced %u re-tap suppressed %u",
+		    tap_state.raw_reads, tap_state.taps, tap_state.coalesced,
+		    tap_state.too_soon);
+
+	return 0;
+}
+
+/* Simulated reader: APDUs and bytes a phone exchanges to read the default
+ * message of each category, for the given MLe.
+ */
+static int cmd_apdu(const struct shell *sh, size_t argc, char **argv)
+{
+	uint16_t mle = T4T_READER_MLE;
+	struct ndef_read_cost cost;
+	uint32_t size;
+	int err;
+
+	if (argc > 1) {
+		mle = strtoul(argv[1], NULL, 0);
+		if (!mle) {
+			shell_error(sh, "Invalid MLe");
+			return -EINVAL;
+		}
+	}
+
+	shell_print(sh, "%-8s %7s %7s %5s %5s %6s", "category", "message",
+		    "file", "apdus", "reads", "bytes");
+	for (int i = 0; i < ARRAY_SIZE(url_cat); i++) {
+		err = ndef_file_default_size(i, &size);
+		if (err) {
+			shell_error(sh, "Cannot encode category %d (err %d)",
+				    i, err);
+			break;
+		}
+
+		ndef_file_read_cost(size, mle, &cost);
+		shell_print(sh, "%-8s %7u %7u %5u %5u %6u", url_cat[i], size,
+			    IS_ENABLED(CONFIG_CHECKPOINT_NDEF_FILE_FIT) ?
+			    size + NFC_NDEF_FILE_NLEN_FIELD_SIZE :
+			    CONFIG_NDEF_FILE_SIZE,
+			    cost.apdus, cost.reads, cost.bytes);
+	}
+
+	return 0;
 }
 
+/* Simulated reader: queues the events of one phone tap the way
+ * nfc_callback() does, so recorded traces can be replayed over the shell.
+ */
+static int cmd_tap(const struct shell *sh, size_t argc, char **argv)
+{
+	static const nfc_t4t_event_t tap_events[] = {
+		NFC_T4T_EVENT_FIELD_ON,
+		NFC_T4T_EVENT_NDEF_READ,
+		NFC_T4T_EVENT_FIELD_OFF,
+	};
+	struct nfc_event evt = {
+		.timestamp = k_uptime_get_32(),
+		.category = url_id,
+	};
+
+	if (argc > 1) {
+		unsigned long category = strtoul(argv[1], NULL, 0);
+
+		if (category >= ARRAY_SIZE(url_cat)) {
+			shell_error(sh, "Invalid category %s", argv[1]);
+			return -EINVAL;
+		}
+		evt.category = category;
+	}
+
+	conn_boost_field_on();
+
+	for (size_t i = 0; i < ARRAY_SIZE(tap_events); i++) {
+		evt.event = tap_events[i];
+		if (k_msgq_put(&nfc_event_q, &evt, K_NO_WAIT)) {
+			nfc_isr_stats.dropped++;
+			shell_error(sh, "NFC event queue full");
+			break;
+		}
+	}
+	k_sem_give(&main_loop_sem);
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((checkpoint), nfc, NULL, "NFC events, callback timing and tap coalescing",
+		 cmd_nfc, 1, 0);
+SHELL_SUBCMD_ADD((checkpoint), tap, NULL,
+		 "Simulate a phone tap: tap [category]", cmd_tap, 1, 1);
+SHELL_SUBCMD_ADD((checkpoint), apdu, NULL,
+		 "APDUs per tap for each category: apdu [MLe]", cmd_apdu, 1, 1);
+#endif /* CONFIG_CHECKPOINT_SHELL */
+
 static int board_init(void)
 {
 	int err;
 
-	err = dk_buttons_init(NULL);
+	err = dk_buttons_init(button_changed);
 	if (err) {
 		printk("Cannot init buttons (err: %d)\n", err);
 		return err;
@@ -194,6 +549,187 @@ static int board_init(void)
 	return err;
 }
 
+/**
+ * @brief Function for storing a message written by a phone.
+ */
+static void ndef_buf_persist(void)
+{
+	uint32_t size;
+
+	while (atomic_cas(&ndef_buf_state, NDEF_BUF_WRITTEN,
+			  NDEF_BUF_PERSISTING)) {
+		size = MIN(NFC_NDEF_FILE_NLEN_FIELD_SIZE +
+			   sys_get_be16(ndef_msg_buf), sizeof(ndef_msg_buf));
+
+		if (ndef_file_update(atomic_get(&ndef_buf_category),
+				     ndef_msg_buf, size) < 0) {
+			printk("Cannot flash NDEF message!\n");
+		}
+
+		if (atomic_cas(&ndef_buf_state, NDEF_BUF_PERSISTING,
+			       NDEF_BUF_IDLE)) {
+			printk("NDEF message successfully flashed.\n");
+		}
+	}
+}
+
+/**
+ * @brief Function for emulating ndef_msg_buf as a Type 4 Tag.
+ */
+static int nfc_start(void)
+{
+	if (nfc_t4t_setup(nfc_callback, NULL) < 0) {
+		printk("Cannot setup t4t library!\n");
+		return -EIO;
+	}
+	/* Run Read-Write mode for Type 4 Tag platform */
+	if (nfc_t4t_ndef_rwpayload_set(ndef_msg_buf,
+			ndef_file_exposed_size(ndef_msg_buf,
+					       sizeof(ndef_msg_buf))) < 0) {
+		printk("Cannot set payload!\n");
+		return -EIO;
+	}
+	/* Start sensing NFC field */
+	if (nfc_t4t_emulation_start() < 0) {
+		printk("Cannot start emulation!\n");
+		return -EIO;
+	}
+	ndef_msg_valid = true;
+
+	return 0;
+}
+
+static void warm_state_apply(const struct warm_restart_state *st)
+{
+	url_id = st->category < ARRAY_SIZE(url_cat) ? st->category : 0;
+	tap_state.raw_reads = st->raw_reads;
+	tap_state.taps = st->taps;
+	tap_state.coalesced = st->coalesced;
+	tap_state.too_soon = st->too_soon;
+	nfc_isr_stats.count = st->nfc_events;
+	nfc_isr_stats.dropped = st->nfc_dropped;
+	tap_journal_seq_resume(st->next_seq);
+}
+
+/**
+ * @brief Function for restarting with the emulated file and the counters
+ * kept in RAM.
+ *
+ * @details Returns when the state cannot be kept, the caller then reboots
+ * cold.
+ */
+static int checkpoint_warm_restart(void)
+{
+	struct tap_journal_stats jst;
+	struct warm_restart_state st;
+
+	/* A completed phone update is flashed first, one in progress has
+	 * no valid NLEN yet.
+	 */
+	ndef_buf_persist();
+	if (!ndef_msg_valid || atomic_get(&ndef_buf_state) != NDEF_BUF_IDLE) {
+		return -EBUSY;
+	}
+
+	(void)tap_journal_flush();
+	tap_journal_stats_get(&jst);
+
+	st = (struct warm_restart_state){
+		.next_seq = jst.next_seq,
+		.raw_reads = tap_state.raw_reads,
+		.taps = tap_state.taps,
+		.coalesced = tap_state.coalesced,
+		.too_soon = tap_state.too_soon,
+		.nfc_events = nfc_isr_stats.count,
+		.nfc_dropped = nfc_isr_stats.dropped,
+		.category = url_id,
+	};
+
+	return warm_restart(&st, ndef_msg_buf, sizeof(ndef_msg_buf));
+}
+
+#if defined(CONFIG_CHECKPOINT_SHELL)
+static int cmd_restart(const struct shell *sh, size_t argc, char **argv)
+{
+	struct warm_restart_stats st;
+	int err;
+
+	if (argc < 2) {
+		warm_restart_stats_get(&st);
+		shell_print(sh, "%s boot, %u warm restarts, %u in a row, tappable after %u us",
+			    st.warm_boot ? "warm" : "cold", st.restarts,
+			    st.consecutive, boot_profile_get(BOOT_TAPPABLE));
+		return 0;
+	}
+
+	if (!strcmp(argv[1], "warm")) {
+		err = checkpoint_warm_restart();
+		shell_error(sh, "Warm restart not possible (err %d)", err);
+		return err;
+	}
+
+	if (!strcmp(argv[1], "cold")) {
+		sys_reboot(SYS_REBOOT_COLD);
+	}
+
+	shell_error(sh, "Usage: restart [warm|cold]");
+	return -EINVAL;
+}
+
+SHELL_SUBCMD_ADD((checkpoint), restart, NULL,
+		 "Warm restart counters, or restart: restart [warm|cold]",
+		 cmd_restart, 1, 1);
+#endif /* CONFIG_CHECKPOINT_SHELL */
+
+/**
+ * @brief Function for replacing the emulated NDEF file with the default
+ * message of the active URL category.
+ */
+static int ndef_default_apply(void)
+{
+	if (nfc_t4t_emulation_stop() < 0) {
+		printk("Cannot start emulation!\n");
+		return -EIO;
+	}
+	/* Keep what a phone wrote to the previous category. */
+	ndef_buf_persist();
+	if (ndef_restore_default(url_id, ndef_msg_buf,
+				 sizeof(ndef_msg_buf)) < 0) {
+		printk("Cannot flash NDEF message!\n");
+		return -EIO;
+	}
+	if (nfc_t4t_ndef_rwpayload_set(ndef_msg_buf,
+			ndef_file_exposed_size(ndef_msg_buf,
+					       sizeof(ndef_msg_buf))) < 0) {
+		printk("Cannot set payload!\n");
+		return -EIO;
+	}
+	if (nfc_t4t_emulation_start() < 0) {
+		printk("Cannot start emulation!\n");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/** Set by bt_ready() once the handover address is known. */
+static atomic_t handover_pending;
+
+static void handover_addr_update(void)
+{
+	bt_addr_le_t addr;
+	size_t count = 1;
+
+	bt_id_get(&addr, &count);
+	if (!count) {
+		return;
+	}
+
+	ndef_file_handover_set(&addr);
+	atomic_set(&handover_pending, 1);
+	k_sem_give(&main_loop_sem);
+}
+
 static void bt_ready(int err)
 {
 	if (err) {
@@ -202,12 +738,32 @@ static void bt_ready(int err)
 	}
 
 	printk("Bluetooth initialized\n");
+	boot_profile_mark(BOOT_BT_READY);
+
+	if (IS_ENABLED(CONFIG_CHECKPOINT_NFC_HANDOVER)) {
+		handover_addr_update();
+	}
+
+	if (IS_ENABLED(CONFIG_CHECKPOINT_ENERGY) && energy_init()) {
+		printk("Radio time accounting unavailable\n");
+	}
+
+	if (IS_ENABLED(CONFIG_CHECKPOINT_RELAY) && relay_init(relay_deliver)) {
+		printk("Tap relay unavailable\n");
+	}
 
 	err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), NULL, 0);
 	if (err) {
 		printk("Advertising failed to start (err %d)\n", err);
 		return;
 	}
+	boot_profile_mark(BOOT_ADVERTISING);
+
+	if ((IS_ENABLED(CONFIG_CHECKPOINT_LONG_RANGE) ||
+	     IS_ENABLED(CONFIG_CHECKPOINT_PHY_ADAPT)) &&
+	    link_phy_init(ad, ARRAY_SIZE(ad))) {
+		printk("Long range or PHY selection unavailable\n");
+	}
 }
 
 /**
@@ -215,76 +771,96 @@ static void bt_ready(int err)
  */
 int main(void)
 {
+	struct warm_restart_state warm;
+	bool warm_boot;
+	uint32_t button_state;
+
+	boot_profile_mark(BOOT_MAIN);
+	timing_init();
+	timing_start();
 	printk("Starting Nordic NFC Writable NDEF Message example\n");
 
+	/* After a warm restart the file in RAM is emulated right away, NVS,
+	 * Bluetooth and the journal come up behind it. Events of early taps
+	 * wait in the queue for the main loop.
+	 */
+	warm_boot = warm_restart_take(&warm, ndef_msg_buf,
+				      sizeof(ndef_msg_buf));
+	if (warm_boot) {
+		warm_state_apply(&warm);
+		if (nfc_start() < 0) {
+			goto fail;
+		}
+		boot_profile_mark(BOOT_TAPPABLE);
+		printk("Warm restart, emulating category %d\n", url_id);
+	}
+
 	/* Configure LED-pins as outputs. */
 	if (board_init() < 0) {
 		printk("Cannot initialize board!\n");
 		goto fail;
 	}
+	boot_profile_mark(BOOT_BOARD);
+
+	notify_queue_init(&lab2_service.attrs[4]);
+
+	/* Bluetooth initializes in the background, overlapping with the NVS
+	 * mount and NDEF load below. Advertising starts from bt_ready().
+	 */
+	int err = bt_enable(bt_ready);
+
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+	}
+	boot_profile_mark(BOOT_BT_ENABLE);
+
 	/* Initialize NVS. */
 	if (ndef_file_setup() < 0) {
 		printk("Cannot setup NDEF file!\n");
 		goto fail;
 	}
-	/* Load NDEF message from the flash file. */
-	if (ndef_file_load(url_id, ndef_msg_buf, sizeof(ndef_msg_buf)) < 0) {
-		printk("Cannot load NDEF file!\n");
-		goto fail;
-	}
-
-	/* Restore default NDEF message if button is pressed. */
-	uint32_t button_state;
-
-	dk_read_buttons(&button_state, NULL);
-	if (button_state & NDEF_RESTORE_BTN_MSK) {
-		if (ndef_restore_default(url_id, ndef_msg_buf,
-					 sizeof(ndef_msg_buf)) < 0) {
-			printk("Cannot flash NDEF message!\n");
+	boot_profile_mark(BOOT_NVS);
+	if (!warm_boot) {
+		/* Load NDEF message from the flash file. */
+		if (ndef_file_load(url_id, ndef_msg_buf,
+				   sizeof(ndef_msg_buf)) < 0) {
+			printk("Cannot load NDEF file!\n");
 			goto fail;
 		}
-		printk("Default NDEF message restored!\n");
-	}
-	/* Set up NFC */
-	int err = nfc_t4t_setup(nfc_callback, NULL);
 
-	if (err < 0) {
-		printk("Cannot setup t4t library!\n");
-		goto fail;
-	}
-	/* Run Read-Write mode for Type 4 Tag platform */
-	if (nfc_t4t_ndef_rwpayload_set(ndef_msg_buf,
-				       sizeof(ndef_msg_buf)) < 0) {
-		printk("Cannot set payload!\n");
-		goto fail;
-	}
-	/* Start sensing NFC field */
-	if (nfc_t4t_emulation_start() < 0) {
-		printk("Cannot start emulation!\n");
-		goto fail;
+		/* Restore default NDEF message if button is pressed. */
+		dk_read_buttons(&button_state, NULL);
+		if (button_state & NDEF_RESTORE_BTN_MSK) {
+			if (ndef_restore_default(url_id, ndef_msg_buf,
+						 sizeof(ndef_msg_buf)) < 0) {
+				printk("Cannot flash NDEF message!\n");
+				goto fail;
+			}
+			printk("Default NDEF message restored!\n");
+		}
+		boot_profile_mark(BOOT_NDEF);
+		/* Set up NFC */
+		if (nfc_start() < 0) {
+			goto fail;
+		}
+		boot_profile_mark(BOOT_TAPPABLE);
 	}
 	printk("Starting NFC Writable NDEF Message example\n");
 	dk_set_led_on(url_id==0?DK_LED1:url_id==1?DK_LED2:url_id==2?DK_LED3:DK_LED4);
 
-	int err_2;
-
-	err_2 = bt_enable(bt_ready);
-	if (err_2) {
-		printk("Bluetooth init failed (err %d)\n", err_2);
-		return;
+	/* Mount the offline tap journal, taps are still reported without it. */
+	if (tap_journal_init() < 0) {
+		printk("Tap journal unavailable!\n");
+	} else {
+		/* Centrals may have subscribed while the journal was still
+		 * unmounted, send them the backlog now.
+		 */
+		notify_queue_journal_kick();
 	}
+	boot_profile_mark(BOOT_JOURNAL);
+	warm_restart_settled();
 
 	while (true) {
-		/*if (atomic_cas(&op_flags, FLASH_BUF_PREP_FINISHED,
-				FLASH_WRITE_STARTED)) {
-			if (ndef_file_update(0, flash_buf, flash_buf_len) < 0) {
-				printk("Cannot flash NDEF message!\n");
-			} else {
-				printk("NDEF message successfully flashed.\n");
-			}
-
-			atomic_set(&op_flags, FLASH_WRITE_FINISHED);
-		}*/
 		bool seturl = false;
 		dk_read_buttons(&button_state, NULL);
 		if ( url_id != 0 && ( button_state & DK_BTN1_MSK ) )
@@ -307,24 +883,15 @@ int main(void)
             url_id = 3;
 			seturl = true;
 		}
+		atomic_val_t category = atomic_set(&category_request, -1);
+
+		if (category >= 0 && category != url_id) {
+			url_id = category;
+			seturl = true;
+		}
 		if ( seturl )
 		{
-			if (nfc_t4t_emulation_stop() < 0) {
-				printk("Cannot start emulation!\n");
-				goto fail;
-			}
-			if (ndef_restore_default(url_id, ndef_msg_buf,
-						sizeof(ndef_msg_buf)) < 0) {
-				printk("Cannot flash NDEF message!\n");
-				goto fail;
-			}
-			if (nfc_t4t_ndef_rwpayload_set(ndef_msg_buf,
-					sizeof(ndef_msg_buf)) < 0) {
-				printk("Cannot set payload!\n");
-				goto fail;
-			}
-			if (nfc_t4t_emulation_start() < 0) {
-				printk("Cannot start emulation!\n");
+			if (ndef_default_apply() < 0) {
 				goto fail;
 			}
 			dk_set_leds( DK_NO_LEDS_MSK );
@@ -333,17 +900,38 @@ int main(void)
 			printk("Switch URL-%d (%s) done.\n", url_id+1, url_cat[url_id] );			 
 		}
 
-        if ( notify_scan )
-		{
-			bt_gatt_notify(NULL, &lab2_service.attrs[1], (bt_notifs[url_id]), strlen(bt_notifs[url_id]));
-		    notify_scan = false;
+		/* The first default message may have been built before the
+		 * Bluetooth identity was known. Only that message is rebuilt,
+		 * a message written by a phone is kept as it is.
+		 */
+		if (IS_ENABLED(CONFIG_CHECKPOINT_NFC_HANDOVER) &&
+		    atomic_cas(&handover_pending, 1, 0) &&
+		    !ndef_file_handover_present(ndef_msg_buf,
+						sizeof(ndef_msg_buf)) &&
+		    ndef_file_plain_default(url_id, ndef_msg_buf,
+					    sizeof(ndef_msg_buf))) {
+			if (ndef_default_apply() < 0) {
+				goto fail;
+			}
+			printk("Connection handover record added.\n");
+		}
+
+		struct nfc_event evt;
+
+		while (k_msgq_get(&nfc_event_q, &evt, K_NO_WAIT) == 0) {
+			nfc_event_process(&evt);
 		}
+		ndef_buf_persist();
 
-		__WFE();
+		k_sem_take(&main_loop_sem, K_FOREVER);
 	}
 
 fail:
 	#if CONFIG_REBOOT
+		/* Back to tappable fastest from the state in RAM, a cold boot
+		 * when it cannot be kept.
+		 */
+		(void)checkpoint_warm_restart();
 		sys_reboot(SYS_REBOOT_COLD);
 	#endif /* CONFIG_REBOOT */
 		return -EIO;
@@ -14,17 +14,30 @@
  */
 
 #include <zephyr/kernel.h>
+#include <zephyr/timing/timing.h>
 #include <soc.h>
 #include <zephyr/device.h>
 #include <string.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/fs/nvs.h>
 #include <nfc/t4t/ndef_file.h>
 #include <nfc/ndef/uri_msg.h>
+#include <nfc/ndef/uri_rec.h>
+#include <nfc/ndef/msg.h>
+#include <nfc/ndef/ch.h>
+#include <nfc/ndef/ch_msg.h>
+#include <nfc/ndef/le_oob_rec.h>
+#include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/storage/flash_map.h>
 
 #include "ndef_file_m.h"
 
 #define FLASH_URL_ADDRESS_ID 1 /**< Address of URL message in FLASH */
+/** Scratch ID of the storage benchmark, after the category messages. */
+#define FLASH_BENCH_ID (FLASH_URL_ADDRESS_ID + \
+			NDEF_FILE_CATEGORIES * CONFIG_NDEF_FILE_SIZE)
+/** Encode buffer of the benchmark, on the caller's stack. */
+#define BENCH_BUF_SIZE 256
 
 //static const uint8_t m_url[] = /**< Default NDEF message: URL "nordicsemi.com". */
 //	{'n', 'o', 'r', 'd', 'i', 'c', 's', 'e', 'm', 'i', '.', 'c', 'o', 'm'};
@@ -35,22 +48,75 @@ static const char url3[] = "forms.gle/2ra6XanJvxNrh9xTA";
 static const char url4[] = "forms.gle/Gs5diyMgjs6YHkmNA";
 static const char* urls[] = { url1, url2, url3, url4 };
 
+BUILD_ASSERT(ARRAY_SIZE(urls) == NDEF_FILE_CATEGORIES,
+	     "One default message per category");
+
 /* Flash partition for NVS */
 #define NVS_FLASH_DEVICE FIXED_PARTITION_DEVICE(storage_partition)
 /* Flash block size in bytes */
 #define NVS_SECTOR_SIZE  (DT_PROP(DT_CHOSEN(zephyr_flash), erase_block_size))
-#define NVS_SECTOR_COUNT 2
+#define NVS_SECTOR_COUNT CONFIG_NDEF_FILE_NVS_SECTOR_COUNT
 /* Start address of the filesystem in flash */
 #define NVS_STORAGE_OFFSET FIXED_PARTITION_OFFSET(storage_partition)
 
+BUILD_ASSERT(NVS_SECTOR_COUNT * NVS_SECTOR_SIZE <=
+	     FIXED_PARTITION_SIZE(storage_partition),
+	     "NVS sectors do not fit in the storage partition");
+
 static struct nvs_fs fs = {
 	.sector_size = NVS_SECTOR_SIZE,
 	.sector_count = NVS_SECTOR_COUNT,
 	.offset = NVS_STORAGE_OFFSET,
 };
 
+static struct ndef_file_stats stats;
+static size_t largest_write; /**< Largest record written, GC threshold. */
+
+/* Garbage collection runs on its own queue at the lowest application
+ * priority, so it only gets the CPU when nothing else is runnable.
+ */
+static K_THREAD_STACK_DEFINE(gc_stack, CONFIG_NDEF_FILE_GC_STACK_SIZE);
+static struct k_work_q gc_work_q;
+static bool gc_started;
+
+static void gc_handler(struct k_work *work);
+static K_WORK_DEFINE(gc_work, gc_handler);
+
+static void gc_handler(struct k_work *work)
+{
+	uint32_t start;
+	int err;
+
+	ARG_UNUSED(work);
+
+	start = k_cycle_get_32();
+	/* Close the active sector, the next one is garbage collected now
+	 * instead of inside a later nvs_write().
+	 */
+	err = nvs_sector_use_next(&fs);
+	if (err) {
+		printk("NVS garbage collection failed (err %d)\n", err);
+		return;
+	}
+
+	stats.idle_gc++;
+	stats.gc_worst_us = MAX(stats.gc_worst_us,
+				k_cyc_to_us_ceil32(k_cycle_get_32() - start));
+}
+
+static void gc_check(void)
+{
+	ssize_t free_space = nvs_sector_max_data_size(&fs);
+
+	if (free_space >= 0 && (size_t)free_space < largest_write) {
+		k_work_submit_to_queue(&gc_work_q, &gc_work);
+	}
+}
+
 int ndef_file_setup(void)
 {
+	uint32_t start;
+	ssize_t free_space;
 	int err;
 
 	fs.flash_device = NVS_FLASH_DEVICE;
@@ -58,9 +124,23 @@ int ndef_file_setup(void)
 		return -ENODEV;
 	}
 
+	start = k_cycle_get_32();
 	err = nvs_mount(&fs);
+	stats.mount_us = k_cyc_to_us_ceil32(k_cycle_get_32() - start);
 	if (err < 0) {
 		printk("Cannot initialize NVS!\n");
+		return err;
+	}
+	free_space = nvs_calc_free_space(&fs);
+	stats.mount_free = free_space > 0 ? free_space : 0;
+
+	/* Setup runs again to remount, e.g. between test suites. */
+	if (!gc_started) {
+		k_work_queue_start(&gc_work_q, gc_stack,
+				   K_THREAD_STACK_SIZEOF(gc_stack),
+				   K_LOWEST_APPLICATION_THREAD_PRIO, NULL);
+		k_thread_name_set(&gc_work_q.thread, "nvs_gc");
+		gc_started = true;
 	}
 
 	return err;
@@ -68,8 +148,299 @@ int ndef_file_setup(void)
 
 int ndef_file_update(int index, uint8_t const *buff, uint32_t size)
 {
+	uint32_t start;
+	uint32_t elapsed;
+	ssize_t sector_free;
+	int err;
+
+	largest_write = MAX(largest_write, size + CONFIG_NDEF_FILE_GC_MARGIN);
+	sector_free = nvs_sector_max_data_size(&fs);
+
 	/* Update FLASH file with new NDEF message. */
-	return nvs_write(&fs, FLASH_URL_ADDRESS_ID+index*CONFIG_NDEF_FILE_SIZE, buff, size);
+	start = k_cycle_get_32();
+	err = nvs_write(&fs, FLASH_URL_ADDRESS_ID+index*CONFIG_NDEF_FILE_SIZE, buff, size);
+	elapsed = k_cyc_to_us_ceil32(k_cycle_get_32() - start);
+
+	if (err > 0) {
+		stats.writes++;
+		stats.write_worst_us = MAX(stats.write_worst_us, elapsed);
+		if (sector_free >= 0 && (size_t)sector_free < size) {
+			/* The idle GC did not get ahead of this write. */
+			stats.inline_gc++;
+		}
+	}
+	if (err >= 0) {
+		gc_check();
+	}
+
+	return err;
+}
+
+void ndef_file_stats_get(struct ndef_file_stats *out)
+{
+	ssize_t free_space = nvs_calc_free_space(&fs);
+
+	*out = stats;
+	out->free_bytes = free_space > 0 ? free_space : 0;
+}
+
+/* Benchmark timestamps come from the timing API, set up by main(). On
+ * nRF52 k_cycle_get_32() counts the 32.768 kHz RTC, about 31 us per tick,
+ * which is longer than encoding a message. Boards without a timing
+ * counter, such as native_sim, fall back to the kernel cycle counter.
+ */
+#if defined(CONFIG_TIMING_FUNCTIONS)
+typedef timing_t bench_time_t;
+
+static bench_time_t bench_now(void)
+{
+	return timing_counter_get();
+}
+
+static uint32_t bench_us_since(bench_time_t start)
+{
+	timing_t end = timing_counter_get();
+
+	return timing_cycles_to_ns(timing_cycles_get(&start, &end)) / 1000;
+}
+#else
+typedef uint32_t bench_time_t;
+
+static bench_time_t bench_now(void)
+{
+	return k_cycle_get_32();
+}
+
+static uint32_t bench_us_since(bench_time_t start)
+{
+	return k_cyc_to_us_floor32(k_cycle_get_32() - start);
+}
+#endif
+
+static void bench_add(struct ndef_file_bench_stat *st, bench_time_t start)
+{
+	uint32_t us = bench_us_since(start);
+
+	st->min_us = st->count ? MIN(st->min_us, us) : us;
+	st->max_us = MAX(st->max_us, us);
+	st->total_us += us;
+	st->count++;
+}
+
+int ndef_file_bench_run(uint32_t rounds, struct ndef_file_bench *bench)
+{
+	uint8_t buf[BENCH_BUF_SIZE];
+	uint32_t size;
+	bench_time_t start;
+	int err;
+
+	memset(bench, 0, sizeof(*bench));
+
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		for (uint32_t r = 0; r < rounds; r++) {
+			size = sizeof(buf);
+			start = bench_now();
+			err = ndef_file_default_message(i, buf, &size);
+			if (err) {
+				return err;
+			}
+			bench_add(&bench->encode[i], start);
+		}
+		bench->encode[i].bytes = size;
+	}
+
+	/* The last encoded message, written and read like a phone update. */
+	bench->write.bytes = size;
+	bench->read.bytes = size;
+
+	for (uint32_t r = 0; r < rounds; r++) {
+		buf[size - 1] = r;
+		start = bench_now();
+		err = nvs_write(&fs, FLASH_BENCH_ID, buf, size);
+		if (err < 0) {
+			goto out;
+		}
+		bench_add(&bench->write, start);
+
+		start = bench_now();
+		err = nvs_read(&fs, FLASH_BENCH_ID, buf, size);
+		if (err < 0) {
+			goto out;
+		}
+		bench_add(&bench->read, start);
+	}
+	err = 0;
+
+out:
+	(void)nvs_delete(&fs, FLASH_BENCH_ID);
+	gc_check();
+
+	return err;
+}
+
+/* APDU sizes of the Type 4 Tag read procedure, status words included. */
+#define APDU_SW_LEN          2
+#define APDU_SELECT_APP_LEN  13 /**< Header, Lc, 7-byte AID and Le. */
+#define APDU_SELECT_FILE_LEN 7  /**< Header, Lc and 2-byte file ID. */
+#define APDU_READ_LEN        5  /**< Header and Le. */
+#define T4T_CC_LEN           15
+
+uint32_t ndef_file_exposed_size(const uint8_t *buff, uint32_t size)
+{
+	uint32_t fit;
+
+	if (!IS_ENABLED(CONFIG_CHECKPOINT_NDEF_FILE_FIT)) {
+		return size;
+	}
+
+	fit = NFC_NDEF_FILE_NLEN_FIELD_SIZE + sys_get_be16(buff);
+
+	return MIN(fit, size);
+}
+
+void ndef_file_read_cost(uint32_t nlen, uint16_t mle,
+			 struct ndef_read_cost *cost)
+{
+	uint32_t left = nlen;
+
+	/* Select application, select CC, read CC, select NDEF, read NLEN. */
+	cost->apdus = 5;
+	cost->reads = 0;
+	cost->bytes = APDU_SELECT_APP_LEN + APDU_SW_LEN +
+		      APDU_SELECT_FILE_LEN + APDU_SW_LEN +
+		      APDU_READ_LEN + T4T_CC_LEN + APDU_SW_LEN +
+		      APDU_SELECT_FILE_LEN + APDU_SW_LEN +
+		      APDU_READ_LEN + NFC_NDEF_FILE_NLEN_FIELD_SIZE + APDU_SW_LEN;
+
+	while (left && mle) {
+		uint32_t chunk = MIN(left, mle);
+
+		cost->apdus++;
+		cost->reads++;
+		cost->bytes += APDU_READ_LEN + chunk + APDU_SW_LEN;
+		left -= chunk;
+	}
+}
+
+#if defined(CONFIG_CHECKPOINT_NFC_HANDOVER)
+#define NDEF_HEADER_SR BIT(4) /**< Short record, 1-byte payload length. */
+#define NDEF_HEADER_IL BIT(3) /**< ID length field present. */
+
+/** Largest default message without the handover record. */
+#define HANDOVER_PLAIN_MAX 128
+
+static bt_addr_le_t handover_addr;
+static atomic_t handover_ready;
+
+void ndef_file_handover_set(const bt_addr_le_t *addr)
+{
+	bt_addr_le_copy(&handover_addr, addr);
+	atomic_set(&handover_ready, 1);
+}
+
+bool ndef_file_handover_present(const uint8_t *buff, uint32_t size)
+{
+	const uint8_t *msg = nfc_t4t_ndef_file_msg_get(buff);
+	uint32_t msg_len = sys_get_be16(buff);
+	uint32_t pos;
+	uint8_t hdr;
+	uint8_t type_len;
+
+	if (size < NFC_NDEF_FILE_NLEN_FIELD_SIZE + 3 ||
+	    msg_len > size - NFC_NDEF_FILE_NLEN_FIELD_SIZE) {
+		return false;
+	}
+
+	/* Skip the header, type length, payload length and ID length of
+	 * the first record to get to its type.
+	 */
+	hdr = msg[0];
+	type_len = msg[1];
+	pos = 2 + ((hdr & NDEF_HEADER_SR) ? 1 : 4) +
+	      ((hdr & NDEF_HEADER_IL) ? 1 : 0);
+
+	return pos + type_len <= msg_len && type_len == 2 &&
+	       !memcmp(&msg[pos], "Hs", 2);
+}
+
+bool ndef_file_plain_default(int index, const uint8_t *buff, uint32_t size)
+{
+	uint8_t plain[HANDOVER_PLAIN_MAX];
+	uint32_t plain_len = sizeof(plain);
+	uint32_t msg_len = sys_get_be16(buff);
+
+	if (size < NFC_NDEF_FILE_NLEN_FIELD_SIZE ||
+	    nfc_ndef_uri_msg_encode(NFC_URI_HTTPS, urls[index],
+				    strlen(urls[index]), plain, &plain_len)) {
+		return false;
+	}
+
+	return msg_len == plain_len &&
+	       msg_len <= size - NFC_NDEF_FILE_NLEN_FIELD_SIZE &&
+	       !memcmp(nfc_t4t_ndef_file_msg_get(buff), plain, plain_len);
+}
+
+/* Handover select record, Bluetooth LE carrier and the URI record. The
+ * LE Secure Connections OOB values change on every boot while this
+ * message is stored in flash, so only the static carrier data is sent.
+ */
+static int handover_msg_encode(int index, uint8_t *buff, uint32_t *size)
+{
+	struct nfc_ndef_le_oob_rec_payload_desc oob_payload = {
+		.addr = &handover_addr,
+		.local_name = bt_get_name(),
+		.le_role = NFC_NDEF_LE_OOB_REC_LE_ROLE(
+			NFC_NDEF_LE_OOB_REC_LE_ROLE_PERIPH_ONLY),
+		.flags = NFC_NDEF_LE_OOB_REC_FLAGS(BT_LE_AD_NO_BREDR),
+	};
+	struct nfc_ndef_ch_msg_records ch_records;
+	int err;
+
+	NFC_NDEF_LE_OOB_RECORD_DESC_DEF(oob_rec, '0', &oob_payload);
+	NFC_NDEF_CH_AC_RECORD_DESC_DEF(oob_ac, NFC_AC_CPS_ACTIVE, 1, "0", 0);
+	NFC_NDEF_CH_HS_RECORD_DESC_DEF(hs_rec, NFC_NDEF_CH_MSG_MAJOR_VER,
+				       NFC_NDEF_CH_MSG_MINOR_VER, 1);
+	NFC_NDEF_URI_RECORD_DESC_DEF(uri_rec, NFC_URI_HTTPS, urls[index],
+				     strlen(urls[index]));
+	NFC_NDEF_MSG_DEF(hs_msg, 3);
+
+	ch_records.ac = &NFC_NDEF_CH_AC_RECORD_DESC(oob_ac);
+	ch_records.carrier = &NFC_NDEF_LE_OOB_RECORD_DESC(oob_rec);
+	ch_records.cnt = 1;
+
+	err = nfc_ndef_ch_msg_hs_create(&NFC_NDEF_MSG(hs_msg),
+					&NFC_NDEF_CH_RECORD_DESC(hs_rec),
+					&ch_records);
+	if (err) {
+		return err;
+	}
+
+	/* Readers that do not handle connection handover still find the
+	 * URI in the same message.
+	 */
+	err = nfc_ndef_msg_record_add(&NFC_NDEF_MSG(hs_msg),
+				      &NFC_NDEF_URI_RECORD_DESC(uri_rec));
+	if (err) {
+		return err;
+	}
+
+	return nfc_ndef_msg_encode(&NFC_NDEF_MSG(hs_msg), buff, size);
+}
+#endif /* CONFIG_CHECKPOINT_NFC_HANDOVER */
+
+/* Encodes the default message of a category, or only computes its size
+ * when buff is NULL.
+ */
+static int default_msg_encode(int index, uint8_t *buff, uint32_t *size)
+{
+#if defined(CONFIG_CHECKPOINT_NFC_HANDOVER)
+	if (atomic_get(&handover_ready)) {
+		return handover_msg_encode(index, buff, size);
+	}
+#endif
+	/* Encode URI message into buffer. */
+	return nfc_ndef_uri_msg_encode(NFC_URI_HTTPS, urls[index],
+				       strlen(urls[index]), buff, size);
 }
 
 /** .. include_startingpoint_ndef_file_rst */
@@ -78,12 +449,8 @@ int ndef_file_default_message(int index, uint8_t *buff, uint32_t *size)
 	int err;
 	uint32_t ndef_size = nfc_t4t_ndef_file_msg_size_get(*size);
 
-	/* Encode URI message into buffer. */
-	err = nfc_ndef_uri_msg_encode(NFC_URI_HTTPS,
-				      urls[index],
-				      strlen(urls[index]),
-				      nfc_t4t_ndef_file_msg_get(buff),
-				      &ndef_size);
+	err = default_msg_encode(index, nfc_t4t_ndef_file_msg_get(buff),
+				 &ndef_size);
 	if (err) {
 		return err;
 	}
@@ -99,6 +466,13 @@ int ndef_file_default_message(int index, uint8_t *buff, uint32_t *size)
 }
 /** .. include_endpoint_ndef_file_rst */
 
+int ndef_file_default_size(int index, uint32_t *size)
+{
+	*size = nfc_t4t_ndef_file_msg_size_get(CONFIG_NDEF_FILE_SIZE);
+
+	return default_msg_encode(index, NULL, size);
+}
+
 int ndef_restore_default(int index, uint8_t *buff, uint32_t size)
 {
 	int err;
@@ -17,6 +17,46 @@
  */
 
 #include <zephyr/types.h>
+#include <stdbool.h>
+#include <zephyr/bluetooth/addr.h>
+
+/** NDEF file storage counters. */
+struct ndef_file_stats {
+	uint32_t writes;         /**< NVS writes performed. */
+	uint32_t write_worst_us; /**< Worst-case nvs_write() duration. */
+	uint32_t idle_gc;        /**< Sectors collected from the idle queue. */
+	uint32_t inline_gc;      /**< Writes that had to collect a sector. */
+	uint32_t gc_worst_us;    /**< Worst-case idle collection duration. */
+	uint32_t free_bytes;     /**< Free space left in the file system. */
+	uint32_t mount_us;       /**< nvs_mount() duration at boot. */
+	uint32_t mount_free;     /**< Free space found by that mount. */
+};
+
+/** Number of URL categories with a default message. */
+#define NDEF_FILE_CATEGORIES 4
+
+/** Duration of one storage operation over the benchmark rounds. */
+struct ndef_file_bench_stat {
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t total_us;
+	uint32_t bytes;    /**< Size of the data handled per operation. */
+};
+
+/** Storage benchmark results. */
+struct ndef_file_bench {
+	struct ndef_file_bench_stat encode[NDEF_FILE_CATEGORIES];
+	struct ndef_file_bench_stat write;
+	struct ndef_file_bench_stat read;
+};
+
+/** Exchange of a Type 4 Tag reader fetching the NDEF message. */
+struct ndef_read_cost {
+	uint16_t apdus;    /**< Command/response pairs. */
+	uint16_t reads;    /**< READ BINARY commands for the message. */
+	uint32_t bytes;    /**< C-APDU and R-APDU bytes, status words included. */
+};
 
 /**
  * @brief   Function for initializing the NVS module.
@@ -64,6 +104,18 @@ int ndef_file_load(int index, uint8_t *buff, uint32_t size);
  */
 int ndef_file_default_message(int index, uint8_t *buff, uint32_t *size);
 
+/**
+ * @brief Function for getting the size of the default NDEF message without
+ * encoding it.
+ *
+ * @param index URL category.
+ * @param size Pointer to the variable holding the message size, NLEN
+ * excluded.
+ *
+ * @return 0 on success, error code otherwise.
+ */
+int ndef_file_default_size(int index, uint32_t *size);
+
 /**
  * @brief Function for creating and storing the default NDEF message:
  * URL "nordicsemi.com".
@@ -76,6 +128,98 @@ int ndef_file_default_message(int index, uint8_t *buff, uint32_t *size);
  */
 int ndef_restore_default(int index, uint8_t *buff, uint32_t size);
 
+/**
+ * @brief Function for getting the NDEF file size exposed to readers.
+ *
+ * @details With @c CONFIG_CHECKPOINT_NDEF_FILE_FIT the file ends right after
+ * the message, otherwise the whole buffer is exposed.
+ *
+ * @param buff Pointer to the NDEF file.
+ * @param size Size of the buffer.
+ *
+ * @return Size to pass to the Type 4 Tag library.
+ */
+uint32_t ndef_file_exposed_size(const uint8_t *buff, uint32_t size);
+
+/**
+ * @brief Function for estimating the APDU exchange of one tap.
+ *
+ * @details Follows the NFC Forum Type 4 Tag NDEF detection and read
+ * procedure: select the application, select and read the capability
+ * container, select the NDEF file, read NLEN, then read the message in
+ * chunks of at most @p mle bytes.
+ *
+ * @param nlen Length of the NDEF message.
+ * @param mle Largest R-APDU data field the reader uses.
+ * @param cost Pointer filled with the estimate.
+ */
+void ndef_file_read_cost(uint32_t nlen, uint16_t mle,
+			 struct ndef_read_cost *cost);
+
+/**
+ * @brief Function for setting the address advertised in the connection
+ * handover record.
+ *
+ * @details Default messages created afterwards start with a handover
+ * select record for this address. Only available with
+ * @c CONFIG_CHECKPOINT_NFC_HANDOVER.
+ *
+ * @param addr Identity address of the checkpoint.
+ */
+void ndef_file_handover_set(const bt_addr_le_t *addr);
+
+/**
+ * @brief Function for checking if an NDEF file starts with a handover
+ * select record.
+ *
+ * @param buff Pointer to the NDEF file.
+ * @param size Size of the buffer.
+ *
+ * @return true if the first record of the message is a handover select
+ * record.
+ */
+bool ndef_file_handover_present(const uint8_t *buff, uint32_t size);
+
+/**
+ * @brief Function for checking if an NDEF file holds the default message
+ * of a category as created without the handover record.
+ *
+ * @details Only available with @c CONFIG_CHECKPOINT_NFC_HANDOVER.
+ *
+ * @param index URL category.
+ * @param buff Pointer to the NDEF file.
+ * @param size Size of the buffer.
+ *
+ * @return true if the message is that default, unmodified.
+ */
+bool ndef_file_plain_default(int index, const uint8_t *buff, uint32_t size);
+
+/**
+ * @brief Function for benchmarking the storage path.
+ *
+ * @details Times the encoding of every default message, then writes and
+ * reads back the last one encoded, of category
+ * @c NDEF_FILE_CATEGORIES - 1, under a scratch NVS ID, which is deleted
+ * afterwards. Each write changes one byte, NVS skips unchanged data.
+ * Writes count toward the flash wear and may trigger garbage collection.
+ *
+ * @param rounds Repetitions of each operation.
+ * @param bench Pointer filled with the results.
+ *
+ * @return 0 on success, error code otherwise.
+ */
+int ndef_file_bench_run(uint32_t rounds, struct ndef_file_bench *bench);
+
+/**
+ * @brief   Function for reading the storage counters.
+ *
+ * @details Sector erases are @c idle_gc + @c inline_gc, which together
+ * with the flash endurance gives the projected lifetime of the partition.
+ *
+ * @param stats Pointer filled with the counters.
+ */
+void ndef_file_stats_get(struct ndef_file_stats *stats);
+
 /** @} */
 
 #endif /* _NDEF_FILE_M_H__ */
@@ -0,0 +1,353 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @ingroup nfc_writable_ndef_msg_example_notify_queue notify_queue.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Per-connection notification queues for the NFC activity checkpoint.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <string.h>
+#include <errno.h>
+
+#include "notify_queue.h"
+#include "tap_journal.h"
+#include "time_sync.h"
+#include "energy.h"
+
+struct notify_msg {
+	const struct bt_gatt_attr *attr;
+	uint16_t len;
+	uint8_t data[CONFIG_CHECKPOINT_NOTIFY_MSG_MAX];
+};
+
+struct notify_conn {
+	struct bt_conn *conn;
+	uint8_t gen;              /**< Invalidates completions of old links. */
+	uint8_t in_flight;
+	uint8_t head;
+	uint8_t count;
+	bool journal;             /**< Subscribed to the journal. */
+	bool journal_restart;     /**< Replay from the oldest record. */
+	uint32_t journal_cursor;
+	struct notify_queue_stats stats;
+	struct notify_msg msgs[CONFIG_CHECKPOINT_NOTIFY_QUEUE_LEN];
+};
+
+static struct notify_conn conns[CONFIG_BT_MAX_CONN];
+static struct k_spinlock lock;
+static const struct bt_gatt_attr *journal_attr;
+
+static void pump_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(pump_work, pump_handler);
+
+#define TX_TOKEN(_idx, _gen) UINT_TO_POINTER(((_gen) << 8) | (_idx))
+
+static void tx_done(struct bt_conn *conn, void *user_data)
+{
+	uint32_t token = POINTER_TO_UINT(user_data);
+	struct notify_conn *ctx = &conns[token & 0xff];
+	k_spinlock_key_t key;
+
+	ARG_UNUSED(conn);
+
+	key = k_spin_lock(&lock);
+	if (ctx->gen == (token >> 8) && ctx->in_flight) {
+		ctx->in_flight--;
+		ctx->stats.sent++;
+	}
+	k_spin_unlock(&lock, key);
+	energy_notify_sent();
+
+	k_work_reschedule(&pump_work, K_NO_WAIT);
+}
+
+/* Send the next notification of a connection, queued messages first,
+ * then journal records. Only called from the pump work item.
+ */
+static int send_one(struct notify_conn *ctx)
+{
+	struct bt_gatt_notify_params params = {
+		.func = tx_done,
+	};
+	struct notify_msg *msg = NULL;
+	struct bt_conn *conn;
+	struct tap_record rec;
+	uint32_t cursor;
+	k_spinlock_key_t key;
+	uint8_t gen;
+	int err;
+
+	key = k_spin_lock(&lock);
+	conn = ctx->conn ? bt_conn_ref(ctx->conn) : NULL;
+	gen = ctx->gen;
+	if (ctx->count) {
+		msg = &ctx->msgs[ctx->head];
+	}
+	k_spin_unlock(&lock, key);
+
+	if (!conn) {
+		return -EAGAIN;
+	}
+
+	params.user_data = TX_TOKEN(ctx - conns, gen);
+
+	if (msg) {
+		params.attr = msg->attr;
+		params.data = msg->data;
+		params.len = msg->len;
+	} else if (ctx->journal) {
+		if (ctx->journal_restart) {
+			ctx->journal_restart = false;
+			ctx->journal_cursor = 0;
+		}
+		cursor = ctx->journal_cursor;
+		if (tap_journal_read(&cursor, &rec)) {
+			bt_conn_unref(conn);
+			return -EAGAIN;
+		}
+		/* Records are journaled in local time, convert with the
+		 * clock of the central receiving this one. Records of an
+		 * earlier boot count from another uptime origin and go out
+		 * unsynchronized.
+		 */
+		if (!(rec.flags & TAP_RECORD_SYNCED) &&
+		    rec.seq >= tap_journal_boot_seq() &&
+		    time_sync_convert(conn, &rec.timestamp)) {
+			rec.flags |= TAP_RECORD_SYNCED;
+		}
+		params.attr = journal_attr;
+		params.data = &rec;
+		params.len = sizeof(rec);
+	} else {
+		bt_conn_unref(conn);
+		return -EAGAIN;
+	}
+
+	err = bt_gatt_notify_cb(conn, &params);
+	bt_conn_unref(conn);
+	if (err == -ENOMEM) {
+		ctx->stats.retries++;
+		return err;
+	}
+
+	key = k_spin_lock(&lock);
+	if (ctx->gen != gen) {
+		/* Disconnected meanwhile, the context has been reset. */
+		k_spin_unlock(&lock, key);
+		return -EAGAIN;
+	}
+	if (msg) {
+		ctx->head = (ctx->head + 1) % ARRAY_SIZE(ctx->msgs);
+		ctx->count--;
+	} else if (!err) {
+		ctx->journal_cursor = cursor;
+		ctx->stats.journal++;
+	}
+	if (!err) {
+		ctx->in_flight++;
+	} else if (msg) {
+		ctx->stats.dropped++;
+	} else {
+		/* Journal characteristic no longer subscribed. */
+		ctx->journal = false;
+	}
+	k_spin_unlock(&lock, key);
+
+	return 0;
+}
+
+/* Round-robin over the links, one notification per link and pass, so a
+ * slow central only ever holds its own in-flight budget.
+ */
+static void pump_handler(struct k_work *work)
+{
+	bool progress;
+	bool retry = false;
+
+	ARG_UNUSED(work);
+
+	do {
+		progress = false;
+		for (size_t i = 0; i < ARRAY_SIZE(conns); i++) {
+			struct notify_conn *ctx = &conns[i];
+			int err;
+
+			if (!ctx->conn ||
+			    ctx->in_flight >= CONFIG_CHECKPOINT_NOTIFY_IN_FLIGHT) {
+				continue;
+			}
+
+			err = send_one(ctx);
+			if (err == -ENOMEM) {
+				retry = true;
+			} else if (!err) {
+				progress = true;
+			}
+		}
+	} while (progress);
+
+	if (retry) {
+		/* Normally woken by tx_done(), poll in case the buffers are
+		 * held by notifications sent outside of this module.
+		 */
+		k_work_reschedule(&pump_work,
+				  K_MSEC(CONFIG_CHECKPOINT_NOTIFY_RETRY_MS));
+	}
+}
+
+void notify_queue_init(const struct bt_gatt_attr *attr)
+{
+	journal_attr = attr;
+}
+
+int notify_queue_broadcast(const struct bt_gatt_attr *attr,
+			   const void *data, uint16_t len)
+{
+	k_spinlock_key_t key;
+	int queued = 0;
+
+	if (len > CONFIG_CHECKPOINT_NOTIFY_MSG_MAX) {
+		return -EMSGSIZE;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(conns); i++) {
+		struct notify_conn *ctx = &conns[i];
+		struct notify_msg *msg;
+		struct bt_conn *conn;
+		bool subscribed;
+
+		key = k_spin_lock(&lock);
+		conn = ctx->conn ? bt_conn_ref(ctx->conn) : NULL;
+		k_spin_unlock(&lock, key);
+
+		if (!conn) {
+			continue;
+		}
+		subscribed = bt_gatt_is_subscribed(conn, attr,
+						   BT_GATT_CCC_NOTIFY);
+		bt_conn_unref(conn);
+		if (!subscribed) {
+			continue;
+		}
+
+		key = k_spin_lock(&lock);
+		if (ctx->conn != conn) {
+			k_spin_unlock(&lock, key);
+			continue;
+		}
+
+		if (ctx->count == ARRAY_SIZE(ctx->msgs)) {
+			ctx->stats.dropped++;
+			k_spin_unlock(&lock, key);
+			continue;
+		}
+
+		msg = &ctx->msgs[(ctx->head + ctx->count) % ARRAY_SIZE(ctx->msgs)];
+		msg->attr = attr;
+		msg->len = len;
+		memcpy(msg->data, data, len);
+		ctx->count++;
+		queued++;
+		k_spin_unlock(&lock, key);
+	}
+
+	if (queued) {
+		k_work_reschedule(&pump_work, K_NO_WAIT);
+	}
+
+	return queued;
+}
+
+void notify_queue_journal_subscribe(struct bt_conn *conn, bool enable)
+{
+	struct notify_conn *ctx = &conns[bt_conn_index(conn)];
+
+	if (ctx->conn != conn) {
+		return;
+	}
+
+	ctx->journal = enable;
+	ctx->journal_restart = enable;
+
+	if (enable) {
+		/* Replay once the CCC value has been stored. */
+		k_work_reschedule(&pump_work, K_MSEC(1));
+	}
+}
+
+void notify_queue_journal_kick(void)
+{
+	k_work_reschedule(&pump_work, K_NO_WAIT);
+}
+
+int notify_queue_stats_get(struct bt_conn *conn,
+			   struct notify_queue_stats *stats)
+{
+	struct notify_conn *ctx = &conns[bt_conn_index(conn)];
+	k_spinlock_key_t key;
+
+	if (ctx->conn != conn) {
+		return -ENOENT;
+	}
+
+	key = k_spin_lock(&lock);
+	*stats = ctx->stats;
+	stats->queued = ctx->count;
+	stats->in_flight = ctx->in_flight;
+	k_spin_unlock(&lock, key);
+
+	return 0;
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct notify_conn *ctx = &conns[bt_conn_index(conn)];
+	k_spinlock_key_t key;
+	uint8_t gen;
+
+	if (err) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	gen = ctx->gen + 1;
+	memset(ctx, 0, offsetof(struct notify_conn, msgs));
+	ctx->gen = gen;
+	ctx->conn = bt_conn_ref(conn);
+	k_spin_unlock(&lock, key);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct notify_conn *ctx = &conns[bt_conn_index(conn)];
+	k_spinlock_key_t key;
+	struct bt_conn *old;
+
+	ARG_UNUSED(reason);
+
+	key = k_spin_lock(&lock);
+	old = ctx->conn;
+	ctx->conn = NULL;
+	ctx->journal = false;
+	ctx->count = 0;
+	ctx->in_flight = 0;
+	ctx->gen++;
+	k_spin_unlock(&lock, key);
+
+	if (old) {
+		bt_conn_unref(old);
+	}
+}
+
+BT_CONN_CB_DEFINE(notify_queue_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+/** @} */
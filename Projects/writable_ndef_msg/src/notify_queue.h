@@ -0,0 +1,83 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _NOTIFY_QUEUE_H__
+#define _NOTIFY_QUEUE_H__
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_notify_queue notify_queue.h
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Per-connection notification queues for the NFC activity checkpoint.
+ *
+ * Each connection gets its own send queue and a bounded number of
+ * notifications in flight, so a slow central cannot hold all TX buffers.
+ * Completion callbacks of bt_gatt_notify_cb() refill the link; buffer
+ * exhaustion leaves the notification queued and retries it.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+/** Per-connection counters. */
+struct notify_queue_stats {
+	uint32_t queued;    /**< Notifications waiting in the queue. */
+	uint32_t in_flight; /**< Notifications handed to the stack. */
+	uint32_t sent;      /**< Notifications completed. */
+	uint32_t dropped;   /**< Notifications discarded. */
+	uint32_t retries;   /**< Sends deferred by buffer exhaustion. */
+	uint32_t journal;   /**< Journal records sent. */
+};
+
+/**
+ * @brief   Function for setting the attributes used by the queues.
+ *
+ * @param journal_attr Journal characteristic, records from the tap journal
+ * are sent to every connection subscribed to it.
+ */
+void notify_queue_init(const struct bt_gatt_attr *journal_attr);
+
+/**
+ * @brief   Function for queuing a notification to all subscribed centrals.
+ *
+ * @param attr Characteristic to notify.
+ * @param data Value, copied into the queues.
+ * @param len Length of the value, at most CONFIG_CHECKPOINT_NOTIFY_MSG_MAX.
+ *
+ * @return Number of connections the notification was queued for, or a
+ * negative error code.
+ */
+int notify_queue_broadcast(const struct bt_gatt_attr *attr,
+			   const void *data, uint16_t len);
+
+/**
+ * @brief   Function for starting or stopping the journal replay to a central.
+ *
+ * @param conn Connection that wrote the journal CCC.
+ * @param enable True to replay unacknowledged records and follow the
+ * journal, false to stop.
+ */
+void notify_queue_journal_subscribe(struct bt_conn *conn, bool enable);
+
+/**
+ * @brief   Function for signalling that new records are in the journal.
+ */
+void notify_queue_journal_kick(void);
+
+/**
+ * @brief   Function for reading the counters of a connection.
+ *
+ * @param conn Connection.
+ * @param stats Pointer filled with the counters.
+ *
+ * @return 0 on success, -ENOENT if the connection is not tracked.
+ */
+int notify_queue_stats_get(struct bt_conn *conn,
+			   struct notify_queue_stats *stats);
+
+/** @} */
+
+#endif /* _NOTIFY_QUEUE_H__ */
@@ -0,0 +1,329 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @ingroup nfc_writable_ndef_msg_example_relay relay.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Managed-flood relay of taps between checkpoints.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gap.h>
+#include <string.h>
+#include <errno.h>
+
+#include "relay.h"
+
+#if defined(CONFIG_CHECKPOINT_RELAY)
+
+#define RELAY_COMPANY_ID  0xFFFF /**< Reserved for testing by the SIG. */
+#define RELAY_PDU_VERSION 1
+
+/** PDU waiting for its turn on the advertising set. */
+struct relay_entry {
+	struct relay_pdu pdu;
+	uint32_t rx_ms;       /**< Uptime when it entered this node. */
+};
+
+K_MSGQ_DEFINE(relay_q, sizeof(struct relay_entry),
+	      CONFIG_CHECKPOINT_RELAY_QUEUE_LEN, 4);
+
+/** Recently seen (origin, seq) pairs, oldest overwritten first. */
+static struct {
+	bt_addr_le_t origin;
+	uint32_t seq;
+} seen[CONFIG_CHECKPOINT_RELAY_CACHE];
+static uint32_t seen_next;
+static uint32_t seen_count;
+
+static struct k_spinlock lock;
+static struct relay_stats stats;
+static relay_deliver_t deliver_cb;
+static bt_addr_le_t own_addr;
+static struct bt_le_ext_adv *adv;
+static atomic_t adv_busy;
+
+static uint8_t adv_buf[sizeof(uint16_t) + sizeof(struct relay_pdu)];
+static const struct bt_data adv_data[] = {
+	BT_DATA(BT_DATA_MANUFACTURER_DATA, adv_buf, sizeof(adv_buf)),
+};
+
+static const struct bt_le_scan_param scan_param = {
+	.type     = BT_LE_SCAN_TYPE_PASSIVE,
+	.options  = BT_LE_SCAN_OPT_NONE,
+	.interval = BT_GAP_SCAN_FAST_INTERVAL,
+	.window   = BT_GAP_SCAN_FAST_WINDOW,
+};
+
+static void tx_handler(struct k_work *work);
+static K_WORK_DEFINE(tx_work, tx_handler);
+
+/* Returns true if the pair was already seen, records it otherwise. */
+static bool seen_check(const bt_addr_le_t *origin, uint32_t seq)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool found = false;
+
+	for (uint32_t i = 0; i < seen_count; i++) {
+		if (seen[i].seq == seq && !bt_addr_le_cmp(&seen[i].origin, origin)) {
+			found = true;
+			break;
+		}
+	}
+
+	if (!found) {
+		bt_addr_le_copy(&seen[seen_next].origin, origin);
+		seen[seen_next].seq = seq;
+		seen_next = (seen_next + 1) % ARRAY_SIZE(seen);
+		seen_count = MIN(seen_count + 1, ARRAY_SIZE(seen));
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return found;
+}
+
+static void enqueue(const struct relay_pdu *pdu, uint32_t rx_ms)
+{
+	struct relay_entry entry = {
+		.pdu = *pdu,
+		.rx_ms = rx_ms,
+	};
+
+	if (k_msgq_put(&relay_q, &entry, K_NO_WAIT)) {
+		stats.dropped++;
+		return;
+	}
+
+	k_work_submit(&tx_work);
+}
+
+/* Advertises the next queued PDU for a fixed number of events, the sent
+ * callback then moves on to the following one.
+ */
+static void tx_handler(struct k_work *work)
+{
+	struct relay_entry entry;
+	uint32_t age;
+	int err;
+
+	ARG_UNUSED(work);
+
+	if (!atomic_cas(&adv_busy, 0, 1)) {
+		return;
+	}
+
+	if (k_msgq_get(&relay_q, &entry, K_NO_WAIT)) {
+		atomic_clear(&adv_busy);
+		return;
+	}
+
+	age = sys_le16_to_cpu(entry.pdu.age_ms) + (k_uptime_get_32() - entry.rx_ms);
+	entry.pdu.age_ms = sys_cpu_to_le16(MIN(age, UINT16_MAX));
+
+	sys_put_le16(RELAY_COMPANY_ID, adv_buf);
+	memcpy(&adv_buf[sizeof(uint16_t)], &entry.pdu, sizeof(entry.pdu));
+
+	err = bt_le_ext_adv_set_data(adv, adv_data, ARRAY_SIZE(adv_data), NULL, 0);
+	if (!err) {
+		err = bt_le_ext_adv_start(adv,
+			BT_LE_EXT_ADV_START_PARAM(0, CONFIG_CHECKPOINT_RELAY_ADV_EVENTS));
+	}
+	if (err) {
+		printk("Relay advertising failed (err %d)\n", err);
+		stats.dropped++;
+		atomic_clear(&adv_busy);
+		k_work_submit(&tx_work);
+	}
+}
+
+static void adv_sent(struct bt_le_ext_adv *instance,
+		     struct bt_le_ext_adv_sent_info *info)
+{
+	ARG_UNUSED(instance);
+	ARG_UNUSED(info);
+
+	atomic_clear(&adv_busy);
+	k_work_submit(&tx_work);
+}
+
+static const struct bt_le_ext_adv_cb adv_cb = {
+	.sent = adv_sent,
+};
+
+static void pdu_handle(struct relay_pdu *pdu)
+{
+	if (!bt_addr_le_cmp(&pdu->origin, &own_addr)) {
+		return;
+	}
+
+	stats.received++;
+	if (seen_check(&pdu->origin, sys_le32_to_cpu(pdu->seq))) {
+		stats.duplicates++;
+		return;
+	}
+
+	pdu->hops++;
+
+	/* A central is attached: this is the end of the flood. */
+	if (deliver_cb(pdu) > 0) {
+		stats.delivered++;
+		stats.hops_total += pdu->hops;
+		stats.hop_ms_total += sys_le16_to_cpu(pdu->age_ms);
+		return;
+	}
+
+	if (!pdu->ttl) {
+		stats.expired++;
+		return;
+	}
+
+	pdu->ttl--;
+	stats.forwarded++;
+	enqueue(pdu, k_uptime_get_32());
+}
+
+static bool ad_parse(struct bt_data *data, void *user_data)
+{
+	struct relay_pdu *pdu = user_data;
+
+	if (data->type != BT_DATA_MANUFACTURER_DATA) {
+		return true;
+	}
+
+	if (data->data_len == sizeof(adv_buf) &&
+	    sys_get_le16(data->data) == RELAY_COMPANY_ID &&
+	    data->data[sizeof(uint16_t)] == RELAY_PDU_VERSION) {
+		memcpy(pdu, &data->data[sizeof(uint16_t)], sizeof(*pdu));
+	}
+
+	return false;
+}
+
+static void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+		    struct net_buf_simple *ad)
+{
+	struct relay_pdu pdu = { 0 };
+
+	ARG_UNUSED(addr);
+	ARG_UNUSED(rssi);
+
+	if (type != BT_GAP_ADV_TYPE_EXT_ADV) {
+		return;
+	}
+
+	bt_data_parse(ad, ad_parse, &pdu);
+	if (pdu.version == RELAY_PDU_VERSION) {
+		pdu_handle(&pdu);
+	}
+}
+
+int relay_init(relay_deliver_t deliver)
+{
+	size_t count = 1;
+	int err;
+
+	deliver_cb = deliver;
+
+	bt_id_get(&own_addr, &count);
+	if (!count) {
+		return -ENODEV;
+	}
+
+	err = bt_le_ext_adv_create(BT_LE_ADV_PARAM(BT_LE_ADV_OPT_EXT_ADV |
+						   BT_LE_ADV_OPT_USE_IDENTITY,
+						   BT_GAP_ADV_FAST_INT_MIN_1,
+						   BT_GAP_ADV_FAST_INT_MAX_1,
+						   NULL),
+				   &adv_cb, &adv);
+	if (err) {
+		printk("Relay advertising set failed (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_scan_start(&scan_param, scan_cb);
+	if (err) {
+		printk("Relay scanning failed (err %d)\n", err);
+	}
+
+	return err;
+}
+
+void relay_tap(uint32_t seq, uint8_t category, uint32_t timestamp)
+{
+	struct relay_pdu pdu = {
+		.version = RELAY_PDU_VERSION,
+		.ttl = CONFIG_CHECKPOINT_RELAY_TTL,
+		.category = category,
+		.seq = sys_cpu_to_le32(seq),
+	};
+
+	if (!adv) {
+		return;
+	}
+
+	bt_addr_le_copy(&pdu.origin, &own_addr);
+	(void)seen_check(&pdu.origin, seq);
+
+	stats.originated++;
+	enqueue(&pdu, timestamp);
+}
+
+void relay_stats_get(struct relay_stats *out)
+{
+	*out = stats;
+}
+
+#if defined(CONFIG_CHECKPOINT_SHELL)
+static int cmd_relay(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "originated %u received %u duplicates %u forwarded %u "
+		    "expired %u dropped %u queued %u", stats.originated,
+		    stats.received, stats.duplicates, stats.forwarded,
+		    stats.expired, stats.dropped, k_msgq_num_used_get(&relay_q));
+	shell_print(sh, "delivered %u, mean %u hops, %u ms per hop",
+		    stats.delivered,
+		    stats.delivered ? stats.hops_total / stats.delivered : 0,
+		    stats.hops_total ? stats.hop_ms_total / stats.hops_total : 0);
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((checkpoint), relay, NULL, "Tap relay counters",
+		 cmd_relay, 1, 0);
+#endif /* CONFIG_CHECKPOINT_SHELL */
+
+#else
+
+int relay_init(relay_deliver_t deliver)
+{
+	ARG_UNUSED(deliver);
+
+	return -ENOTSUP;
+}
+
+void relay_tap(uint32_t seq, uint8_t category, uint32_t timestamp)
+{
+	ARG_UNUSED(seq);
+	ARG_UNUSED(category);
+	ARG_UNUSED(timestamp);
+}
+
+void relay_stats_get(struct relay_stats *out)
+{
+	*out = (struct relay_stats){ 0 };
+}
+
+#endif /* CONFIG_CHECKPOINT_RELAY */
+
+/** @} */
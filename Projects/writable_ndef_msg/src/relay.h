@@ -0,0 +1,85 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _RELAY_H__
+#define _RELAY_H__
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_relay relay.h
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Managed-flood relay of taps between checkpoints.
+ *
+ * A checkpoint without a central floods its taps as non-connectable
+ * extended advertisements. Other checkpoints rebroadcast them until the
+ * hop limit runs out, and the first one with a central attached delivers
+ * them over the relay characteristic instead of forwarding.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/addr.h>
+#include <zephyr/toolchain.h>
+
+/** Relayed tap, as advertised and as notified to the central. */
+struct relay_pdu {
+	uint8_t version;
+	uint8_t ttl;          /**< Hops left. */
+	uint8_t hops;         /**< Hops taken. */
+	uint8_t category;
+	bt_addr_le_t origin;  /**< Identity address of the tapped checkpoint. */
+	uint32_t seq;         /**< Journal sequence number at the origin. */
+	uint16_t age_ms;      /**< Time spent in the relays so far. */
+} __packed;
+
+/** Relay counters. */
+struct relay_stats {
+	uint32_t originated;  /**< Own taps flooded. */
+	uint32_t received;    /**< PDUs heard from other checkpoints. */
+	uint32_t duplicates;  /**< PDUs already seen. */
+	uint32_t forwarded;   /**< PDUs rebroadcast. */
+	uint32_t delivered;   /**< PDUs handed to a central. */
+	uint32_t expired;     /**< PDUs dropped at the hop limit. */
+	uint32_t dropped;     /**< PDUs lost to a full relay queue. */
+	uint32_t hop_ms_total; /**< Sum of per-hop delays of delivered PDUs. */
+	uint32_t hops_total;  /**< Sum of hop counts of delivered PDUs. */
+};
+
+/**
+ * @brief Callback delivering a PDU to the attached centrals.
+ *
+ * @return Number of centrals the PDU has been queued to.
+ */
+typedef int (*relay_deliver_t)(const struct relay_pdu *pdu);
+
+/**
+ * @brief   Function for starting the relay.
+ *
+ * @details Call after Bluetooth is enabled.
+ *
+ * @param deliver Callback delivering PDUs to the attached centrals.
+ *
+ * @return 0 on success, error code otherwise.
+ */
+int relay_init(relay_deliver_t deliver);
+
+/**
+ * @brief   Function for flooding an own tap.
+ *
+ * @param seq Journal sequence number of the tap.
+ * @param category Category of the tap.
+ * @param timestamp Local uptime of the tap in milliseconds.
+ */
+void relay_tap(uint32_t seq, uint8_t category, uint32_t timestamp);
+
+/**
+ * @brief   Function for reading the relay counters.
+ *
+ * @param stats Pointer filled with the counters.
+ */
+void relay_stats_get(struct relay_stats *stats);
+
+/** @} */
+
+#endif /* _RELAY_H__ */
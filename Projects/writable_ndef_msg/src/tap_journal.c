@@ -0,0 +1,594 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @ingroup nfc_writable_ndef_msg_example_tap_journal tap_journal.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Offline tap journal for the NFC activity checkpoint.
+ *
+ * The journal partition is split into erase pages and treated as one
+ * circular array of fixed-size records. A record is addressed by its log
+ * sequence number (LSN), which only ever grows; the flash slot is
+ * LSN modulo the number of slots. The first slot of every page holds a
+ * page header with the page counter, followed by snapshots of the
+ * acknowledged and reserved sequence numbers, so a page can be recycled
+ * without losing state.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/storage/flash_map.h>
+#include <string.h>
+#include <errno.h>
+
+#include "tap_journal.h"
+
+#if FIXED_PARTITION_EXISTS(journal_partition)
+
+#define JOURNAL_AREA_ID    FIXED_PARTITION_ID(journal_partition)
+#define JOURNAL_AREA_SIZE  FIXED_PARTITION_SIZE(journal_partition)
+/* Flash block size in bytes */
+#define JOURNAL_PAGE_SIZE  (DT_PROP(DT_CHOSEN(zephyr_flash), erase_block_size))
+#define JOURNAL_PAGE_COUNT (JOURNAL_AREA_SIZE / JOURNAL_PAGE_SIZE)
+
+BUILD_ASSERT(JOURNAL_PAGE_COUNT >= 2,
+	     "Journal partition must span at least two erase pages");
+
+enum {
+	REC_PAGE = 0x50,   /**< Page header, seq holds the page counter. */
+	REC_TAP = 0x54,    /**< Tap, seq and value hold seq and timestamp,
+			    *   category holds flags in the upper nibble.
+			    */
+	REC_ACK = 0x41,    /**< seq holds the highest acknowledged tap. */
+	REC_RESV = 0x52,   /**< seq holds the first unreserved number. */
+	REC_ERASED = 0xff,
+};
+
+struct journal_rec {
+	uint8_t type;
+	uint8_t category;
+	uint16_t crc;
+	uint32_t seq;
+	uint32_t value;
+};
+
+BUILD_ASSERT(sizeof(struct journal_rec) % 4 == 0,
+	     "Journal record must be a multiple of the flash write size");
+
+#define RECS_PER_PAGE (JOURNAL_PAGE_SIZE / sizeof(struct journal_rec))
+
+static const struct flash_area *fa;
+static K_MUTEX_DEFINE(journal_lock);
+
+static struct journal_rec batch[CONFIG_CHECKPOINT_JOURNAL_BATCH];
+static uint32_t batch_len;
+
+static uint32_t head_lsn;    /**< Next slot to be written. */
+static uint32_t flushed_lsn; /**< First slot still held in RAM. */
+static uint32_t tail_lsn;    /**< Oldest slot still held in flash. */
+static uint32_t next_seq = 1;
+static uint32_t resv_seq;
+static uint32_t acked_seq;
+static atomic_t ack_seq;    /**< Latest acknowledgement, not journaled yet. */
+static uint32_t resume_seq; /**< Next number kept over a warm restart. */
+static uint32_t boot_seq;   /**< First number issued since this boot. */
+
+static struct tap_journal_stats stats;
+
+static void journal_flush_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(flush_work, journal_flush_handler);
+static void journal_ack_handler(struct k_work *work);
+static K_WORK_DEFINE(ack_work, journal_ack_handler);
+
+static uint16_t rec_crc(const struct journal_rec *rec)
+{
+	uint16_t crc;
+
+	crc = crc16_ccitt(0xffff, &rec->type, 2);
+	return crc16_ccitt(crc, (const uint8_t *)&rec->seq,
+			   sizeof(*rec) - offsetof(struct journal_rec, seq));
+}
+
+static bool rec_valid(const struct journal_rec *rec)
+{
+	return rec->type != REC_ERASED && rec->crc == rec_crc(rec);
+}
+
+static bool rec_erased(const struct journal_rec *rec)
+{
+	const uint8_t *p = (const uint8_t *)rec;
+
+	for (size_t i = 0; i < sizeof(*rec); i++) {
+		if (p[i] != 0xff) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static off_t lsn_offset(uint32_t lsn)
+{
+	uint32_t page = (lsn / RECS_PER_PAGE) % JOURNAL_PAGE_COUNT;
+
+	return page * JOURNAL_PAGE_SIZE +
+	       (lsn % RECS_PER_PAGE) * sizeof(struct journal_rec);
+}
+
+static int rec_get(uint32_t lsn, struct journal_rec *rec)
+{
+	if (lsn >= flushed_lsn) {
+		*rec = batch[lsn - flushed_lsn];
+		return 0;
+	}
+
+	return flash_area_read(fa, lsn_offset(lsn), rec, sizeof(*rec));
+}
+
+/* Count the unacknowledged taps on a page that is about to be erased. */
+static void page_recycle(uint32_t page_lsn)
+{
+	struct journal_rec rec;
+
+	for (uint32_t lsn = page_lsn; lsn < page_lsn + RECS_PER_PAGE; lsn++) {
+		if (lsn < tail_lsn) {
+			continue;
+		}
+		if (flash_area_read(fa, lsn_offset(lsn), &rec, sizeof(rec)) ||
+		    rec_erased(&rec)) {
+			break;
+		}
+		if (rec_valid(&rec) && rec.type == REC_TAP &&
+		    rec.seq > acked_seq) {
+			stats.dropped++;
+		}
+	}
+
+	tail_lsn = MAX(tail_lsn, page_lsn + RECS_PER_PAGE);
+}
+
+static int batch_flush(void)
+{
+	uint32_t i = 0;
+	int err;
+
+	while (i < batch_len) {
+		uint32_t lsn = flushed_lsn + i;
+		uint32_t slot = lsn % RECS_PER_PAGE;
+		uint32_t run = MIN(batch_len - i, RECS_PER_PAGE - slot);
+
+		if (slot == 0) {
+			/* The oldest page is reused for the new one. */
+			if (lsn >= JOURNAL_PAGE_COUNT * RECS_PER_PAGE) {
+				page_recycle(lsn - JOURNAL_PAGE_COUNT *
+						   RECS_PER_PAGE);
+			}
+			err = flash_area_erase(fa, lsn_offset(lsn),
+					       JOURNAL_PAGE_SIZE);
+			if (err) {
+				return err;
+			}
+			stats.page_erases++;
+		}
+
+		err = flash_area_write(fa, lsn_offset(lsn), &batch[i],
+				       run * sizeof(struct journal_rec));
+		if (err) {
+			return err;
+		}
+		i += run;
+	}
+
+	flushed_lsn += batch_len;
+	batch_len = 0;
+	stats.flushes++;
+
+	return 0;
+}
+
+static int rec_push(uint8_t type, uint8_t category, uint32_t seq,
+		    uint32_t value)
+{
+	struct journal_rec *rec;
+	int err;
+
+	if (batch_len == ARRAY_SIZE(batch)) {
+		err = batch_flush();
+		if (err) {
+			return err;
+		}
+	}
+
+	rec = &batch[batch_len++];
+	rec->type = type;
+	rec->category = category;
+	rec->seq = seq;
+	rec->value = value;
+	rec->crc = rec_crc(rec);
+	head_lsn++;
+
+	return 0;
+}
+
+static int rec_append(uint8_t type, uint8_t category, uint32_t seq,
+		      uint32_t value)
+{
+	int err;
+
+	if (head_lsn % RECS_PER_PAGE == 0) {
+		/* Start of a new page: header and state snapshot. */
+		err = rec_push(REC_PAGE, 0, head_lsn / RECS_PER_PAGE, 0);
+		if (!err) {
+			err = rec_push(REC_ACK, 0, acked_seq, 0);
+		}
+		if (!err) {
+			err = rec_push(REC_RESV, 0, resv_seq, 0);
+		}
+		if (err) {
+			return err;
+		}
+	}
+
+	err = rec_push(type, category, seq, value);
+	if (err) {
+		return err;
+	}
+
+	k_work_schedule(&flush_work, K_MSEC(CONFIG_CHECKPOINT_JOURNAL_FLUSH_MS));
+
+	return 0;
+}
+
+static void journal_flush_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	if (tap_journal_flush()) {
+		printk("Cannot flush tap journal!\n");
+	}
+}
+
+static void journal_ack_handler(struct k_work *work)
+{
+	uint32_t seq;
+	int err = 0;
+
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&journal_lock, K_FOREVER);
+
+	seq = atomic_get(&ack_seq);
+	if (seq > acked_seq) {
+		acked_seq = seq;
+		err = rec_append(REC_ACK, 0, seq, 0);
+	}
+
+	k_mutex_unlock(&journal_lock);
+
+	if (err) {
+		printk("Cannot journal acknowledgement %u (err %d)\n", seq, err);
+	}
+}
+
+static int journal_scan(void)
+{
+	struct journal_rec rec;
+	uint32_t head_page = 0;
+	uint32_t head_ctr = 0;
+	bool found = false;
+	int err;
+
+	/* Find the page with the highest counter. */
+	for (uint32_t page = 0; page < JOURNAL_PAGE_COUNT; page++) {
+		err = flash_area_read(fa, page * JOURNAL_PAGE_SIZE, &rec,
+				      sizeof(rec));
+		if (err) {
+			return err;
+		}
+		if (rec_valid(&rec) && rec.type == REC_PAGE &&
+		    rec.seq % JOURNAL_PAGE_COUNT == page &&
+		    (!found || rec.seq > head_ctr)) {
+			head_ctr = rec.seq;
+			head_page = page;
+			found = true;
+		}
+	}
+
+	if (!found) {
+		printk("Tap journal empty.\n");
+		return 0;
+	}
+
+	/* Write position is the first erased slot of the head page. */
+	head_lsn = (head_ctr + 1) * RECS_PER_PAGE;
+	for (uint32_t slot = 1; slot < RECS_PER_PAGE; slot++) {
+		err = flash_area_read(fa, head_page * JOURNAL_PAGE_SIZE +
+				      slot * sizeof(rec), &rec, sizeof(rec));
+		if (err) {
+			return err;
+		}
+		if (rec_erased(&rec)) {
+			head_lsn = head_ctr * RECS_PER_PAGE + slot;
+			break;
+		}
+	}
+	flushed_lsn = head_lsn;
+
+	/* Oldest page of the current generation that is still intact. */
+	tail_lsn = head_ctr * RECS_PER_PAGE;
+	for (uint32_t k = 1; k < JOURNAL_PAGE_COUNT && k <= head_ctr; k++) {
+		uint32_t lsn = (head_ctr - k) * RECS_PER_PAGE;
+
+		err = flash_area_read(fa, lsn_offset(lsn), &rec, sizeof(rec));
+		if (err) {
+			return err;
+		}
+		if (!rec_valid(&rec) || rec.type != REC_PAGE ||
+		    rec.seq != head_ctr - k) {
+			break;
+		}
+		tail_lsn = lsn;
+	}
+
+	for (uint32_t lsn = tail_lsn; lsn < head_lsn; lsn++) {
+		err = flash_area_read(fa, lsn_offset(lsn), &rec, sizeof(rec));
+		if (err) {
+			return err;
+		}
+		if (!rec_valid(&rec)) {
+			continue;
+		}
+		switch (rec.type) {
+		case REC_TAP:
+			next_seq = MAX(next_seq, rec.seq + 1);
+			break;
+		case REC_ACK:
+			acked_seq = MAX(acked_seq, rec.seq);
+			break;
+		case REC_RESV:
+			resv_seq = MAX(resv_seq, rec.seq);
+			break;
+		default:
+			break;
+		}
+	}
+
+	printk("Tap journal: LSN %u..%u, next seq %u, reserved %u, acked %u\n",
+	       tail_lsn, head_lsn, next_seq, resv_seq, acked_seq);
+
+	return 0;
+}
+
+int tap_journal_init(void)
+{
+	int err;
+
+	err = flash_area_open(JOURNAL_AREA_ID, &fa);
+	if (err) {
+		printk("Cannot open journal partition!\n");
+		return err;
+	}
+
+	k_mutex_lock(&journal_lock, K_FOREVER);
+
+	err = journal_scan();
+	if (!err && resume_seq >= next_seq && resume_seq <= resv_seq) {
+		/* The exact next number survived a warm restart and is still
+		 * inside the reserved block, carry on without a gap or a
+		 * flash write.
+		 */
+		next_seq = resume_seq;
+	} else if (!err) {
+		/* Numbers between next_seq and resv_seq may already have been
+		 * used before the reset, never hand them out again.
+		 */
+		next_seq = MAX(next_seq, resv_seq);
+		resv_seq = next_seq + CONFIG_CHECKPOINT_JOURNAL_SEQ_BLOCK;
+		err = rec_append(REC_RESV, 0, resv_seq, 0);
+	}
+	if (!err && batch_len) {
+		err = batch_flush();
+	}
+	boot_seq = next_seq;
+
+	k_mutex_unlock(&journal_lock);
+
+	if (err) {
+		printk("Cannot mount tap journal (err %d)\n", err);
+		flash_area_close(fa);
+		fa = NULL;
+	}
+
+	return err;
+}
+
+void tap_journal_seq_resume(uint32_t seq)
+{
+	resume_seq = seq;
+}
+
+int tap_journal_append(uint8_t category, uint8_t flags, uint32_t timestamp,
+		       struct tap_record *rec)
+{
+	int err = 0;
+
+	if (!fa) {
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&journal_lock, K_FOREVER);
+
+	if (next_seq >= resv_seq) {
+		resv_seq = next_seq + CONFIG_CHECKPOINT_JOURNAL_SEQ_BLOCK;
+		err = rec_append(REC_RESV, 0, resv_seq, 0);
+		if (!err) {
+			err = batch_flush();
+		}
+	}
+
+	if (!err) {
+		err = rec_append(REC_TAP, (flags << 4) | (category & 0x0f),
+				 next_seq, timestamp);
+	}
+
+	if (!err) {
+		if (rec) {
+			rec->seq = next_seq;
+			rec->timestamp = timestamp;
+			rec->category = category;
+			rec->flags = flags;
+		}
+		next_seq++;
+		stats.appended++;
+	}
+
+	k_mutex_unlock(&journal_lock);
+
+	return err;
+}
+
+int tap_journal_read(uint32_t *cursor, struct tap_record *rec)
+{
+	struct journal_rec jrec;
+	int err = -ENOENT;
+
+	if (!fa) {
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&journal_lock, K_FOREVER);
+
+	if (*cursor < tail_lsn) {
+		*cursor = tail_lsn;
+	}
+
+	while (*cursor < head_lsn) {
+		if (rec_get((*cursor)++, &jrec)) {
+			continue;
+		}
+		if (rec_valid(&jrec) && jrec.type == REC_TAP &&
+		    jrec.seq > acked_seq) {
+			rec->seq = jrec.seq;
+			rec->timestamp = jrec.value;
+			rec->category = jrec.category & 0x0f;
+			rec->flags = jrec.category >> 4;
+			err = 0;
+			break;
+		}
+	}
+
+	k_mutex_unlock(&journal_lock);
+
+	return err;
+}
+
+int tap_journal_ack(uint32_t seq)
+{
+	atomic_val_t prev;
+
+	if (!fa) {
+		return -ENODEV;
+	}
+
+	/* next_seq only grows, a stale read rejects nothing valid for long. */
+	if (seq >= next_seq) {
+		return -EINVAL;
+	}
+
+	/* Called from the Bluetooth RX thread, which must not wait for a
+	 * flush or a page erase on the journal lock: keep the highest
+	 * acknowledgement and journal it from the system work queue.
+	 */
+	do {
+		prev = atomic_get(&ack_seq);
+		if (seq <= (uint32_t)prev) {
+			return 0;
+		}
+	} while (!atomic_cas(&ack_seq, prev, seq));
+
+	k_work_submit(&ack_work);
+
+	return 0;
+}
+
+int tap_journal_flush(void)
+{
+	int err = 0;
+
+	if (!fa) {
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&journal_lock, K_FOREVER);
+	if (batch_len) {
+		err = batch_flush();
+	}
+	k_mutex_unlock(&journal_lock);
+
+	return err;
+}
+
+uint32_t tap_journal_boot_seq(void)
+{
+	return boot_seq;
+}
+
+void tap_journal_stats_get(struct tap_journal_stats *out)
+{
+	k_mutex_lock(&journal_lock, K_FOREVER);
+	*out = stats;
+	out->acked_seq = acked_seq;
+	out->next_seq = next_seq;
+	k_mutex_unlock(&journal_lock);
+}
+
+#else /* FIXED_PARTITION_EXISTS(journal_partition) */
+
+int tap_journal_init(void)
+{
+	return -ENOTSUP;
+}
+
+void tap_journal_seq_resume(uint32_t seq)
+{
+	ARG_UNUSED(seq);
+}
+
+int tap_journal_append(uint8_t category, uint8_t flags, uint32_t timestamp,
+		       struct tap_record *rec)
+{
+	return -ENOTSUP;
+}
+
+int tap_journal_read(uint32_t *cursor, struct tap_record *rec)
+{
+	return -ENOENT;
+}
+
+int tap_journal_ack(uint32_t seq)
+{
+	return -ENOTSUP;
+}
+
+int tap_journal_flush(void)
+{
+	return 0;
+}
+
+uint32_t tap_journal_boot_seq(void)
+{
+	return 0;
+}
+
+void tap_journal_stats_get(struct tap_journal_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* FIXED_PARTITION_EXISTS(journal_partition) */
+
+/** @} */
@@ -0,0 +1,137 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _TAP_JOURNAL_H__
+#define _TAP_JOURNAL_H__
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_tap_journal tap_journal.h
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Offline tap journal for the NFC activity checkpoint.
+ *
+ * Every tap is appended to a circular log in the journal flash partition
+ * and stays there until a central acknowledges its sequence number.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/sys/util.h>
+
+/** Timestamp of the tap record is in central time. */
+#define TAP_RECORD_SYNCED BIT(0)
+
+/** Tap record as sent to the central over the journal characteristic. */
+struct tap_record {
+	uint32_t seq;       /**< Sequence number, strictly increasing. */
+	uint32_t timestamp; /**< Time of the tap in milliseconds. */
+	uint8_t category;   /**< Index of the active URL category. */
+	uint8_t flags;      /**< TAP_RECORD_* flags. */
+} __packed;
+
+/** Journal counters. */
+struct tap_journal_stats {
+	uint32_t appended;    /**< Taps appended since boot. */
+	uint32_t acked_seq;   /**< Highest sequence number acknowledged. */
+	uint32_t next_seq;    /**< Sequence number of the next tap. */
+	uint32_t dropped;     /**< Unacknowledged taps overwritten. */
+	uint32_t flushes;     /**< Batched flash writes. */
+	uint32_t page_erases; /**< Journal pages recycled. */
+};
+
+/**
+ * @brief   Function for mounting the journal partition.
+ *
+ * @details Scans the partition to recover the write position, the highest
+ * acknowledged sequence number and the next free sequence number.
+ *
+ * @return 0 when the journal is ready, -ENOTSUP if the board has no
+ * journal partition, error code otherwise.
+ */
+int tap_journal_init(void);
+
+/**
+ * @brief   Function for passing the next sequence number kept over a warm
+ * restart, before tap_journal_init().
+ *
+ * @details The journal continues from it when it lies within the block
+ * reserved before the restart, instead of skipping to a new block.
+ *
+ * @param seq Sequence number the next tap would have had.
+ */
+void tap_journal_seq_resume(uint32_t seq);
+
+/**
+ * @brief   Function for appending a tap to the journal.
+ *
+ * @details The record is buffered in RAM and written to flash together
+ * with the following ones, see CONFIG_CHECKPOINT_JOURNAL_BATCH.
+ *
+ * @param category Index of the active URL category, below 16.
+ * @param flags TAP_RECORD_* flags, below 16.
+ * @param timestamp Local uptime or, with TAP_RECORD_SYNCED, central time
+ * of the tap in milliseconds. Local taps are appended in local time and
+ * converted per central when sent.
+ * @param rec Optional pointer filled with the appended record.
+ *
+ * @return 0 when the tap has been appended, error code otherwise.
+ */
+int tap_journal_append(uint8_t category, uint8_t flags, uint32_t timestamp,
+		       struct tap_record *rec);
+
+/**
+ * @brief   Function for reading the next unacknowledged tap.
+ *
+ * @param cursor Read position, 0 to start at the oldest record. Advanced
+ * past the returned record.
+ * @param rec Pointer filled with the tap.
+ *
+ * @return 0 if a tap has been returned, -ENOENT when the cursor is at the
+ * end of the journal.
+ */
+int tap_journal_read(uint32_t *cursor, struct tap_record *rec);
+
+/**
+ * @brief   Function for acknowledging the taps up to a sequence number.
+ *
+ * @details Acknowledged taps are no longer replayed. Nothing is erased,
+ * pages are reused in ring order once the journal wraps. Safe to call from
+ * the Bluetooth RX thread, the acknowledgement is journaled from the
+ * system work queue.
+ *
+ * @param seq Highest sequence number received by the central.
+ *
+ * @return 0 on success, -EINVAL if the sequence number was never issued.
+ */
+int tap_journal_ack(uint32_t seq);
+
+/**
+ * @brief   Function for writing buffered records to flash immediately.
+ *
+ * @return 0 on success, error code otherwise.
+ */
+int tap_journal_flush(void);
+
+/**
+ * @brief   Function for getting the first sequence number issued since
+ *          this boot.
+ *
+ * @details Records below it were appended before a reboot or a warm
+ * restart, their local timestamps count from another uptime origin.
+ *
+ * @return The sequence number, 0 before tap_journal_init().
+ */
+uint32_t tap_journal_boot_seq(void);
+
+/**
+ * @brief   Function for reading the journal counters.
+ *
+ * @param stats Pointer filled with the counters.
+ */
+void tap_journal_stats_get(struct tap_journal_stats *stats);
+
+/** @} */
+
+#endif /* _TAP_JOURNAL_H__ */
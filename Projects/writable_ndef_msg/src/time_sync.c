@@ -0,0 +1,96 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @ingroup nfc_writable_ndef_msg_example_time_sync time_sync.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Central clock tracking for the NFC activity checkpoint.
+ */
+
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include "time_sync.h"
+
+/** Clock of the central on one connection. */
+struct time_sync_conn {
+	int32_t samples[CONFIG_CHECKPOINT_TIME_SYNC_SAMPLES];
+	uint32_t sample_count;
+	uint32_t last_sample_ms;
+	int32_t offset;
+};
+
+static struct k_spinlock lock;
+static struct time_sync_conn conns[CONFIG_BT_MAX_CONN];
+
+void time_sync_sample(struct bt_conn *conn, uint32_t central_ms)
+{
+	struct time_sync_conn *ctx = &conns[bt_conn_index(conn)];
+	uint32_t now = k_uptime_get_32();
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	ctx->samples[ctx->sample_count++ % ARRAY_SIZE(ctx->samples)] =
+		(int32_t)(central_ms - now);
+	ctx->last_sample_ms = now;
+
+	/* The least delayed sample of the window gives the largest offset.
+	 * Old samples age out, which follows the drift of the two crystals.
+	 */
+	ctx->offset = ctx->samples[0];
+	for (uint32_t i = 1;
+	     i < MIN(ctx->sample_count, ARRAY_SIZE(ctx->samples)); i++) {
+		ctx->offset = MAX(ctx->offset, ctx->samples[i]);
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+bool time_sync_offset_get(struct bt_conn *conn, int32_t *out)
+{
+	struct time_sync_conn *ctx = &conns[bt_conn_index(conn)];
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool synced = ctx->sample_count &&
+		      k_uptime_get_32() - ctx->last_sample_ms <
+		      CONFIG_CHECKPOINT_TIME_SYNC_TIMEOUT_MS;
+
+	*out = ctx->offset;
+	k_spin_unlock(&lock, key);
+
+	return synced;
+}
+
+bool time_sync_convert(struct bt_conn *conn, uint32_t *timestamp)
+{
+	int32_t off;
+
+	if (!time_sync_offset_get(conn, &off)) {
+		return false;
+	}
+
+	*timestamp += off;
+
+	return true;
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct time_sync_conn *ctx = &conns[bt_conn_index(conn)];
+	k_spinlock_key_t key;
+
+	ARG_UNUSED(reason);
+
+	/* The next central on this connection slot has its own clock. */
+	key = k_spin_lock(&lock);
+	memset(ctx, 0, sizeof(*ctx));
+	k_spin_unlock(&lock, key);
+}
+
+BT_CONN_CB_DEFINE(time_sync_conn_callbacks) = {
+	.disconnected = disconnected,
+};
+
+/** @} */
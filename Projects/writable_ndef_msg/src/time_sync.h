@@ -0,0 +1,59 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _TIME_SYNC_H__
+#define _TIME_SYNC_H__
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_time_sync time_sync.h
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Central clock tracking for the NFC activity checkpoint.
+ *
+ * Each central periodically writes its uptime in milliseconds. Every write
+ * gives the offset between the two clocks minus the (unknown, positive)
+ * transfer delay, so the largest offset over the recent samples is the
+ * best estimate. Centrals do not share a clock, so the offset is kept per
+ * connection and forgotten on disconnection.
+ */
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <zephyr/bluetooth/conn.h>
+
+/**
+ * @brief   Function for adding a clock sample received from the central.
+ *
+ * @param conn Connection the sample was written on.
+ * @param central_ms Central uptime in milliseconds when it sent the sample.
+ */
+void time_sync_sample(struct bt_conn *conn, uint32_t central_ms);
+
+/**
+ * @brief   Function for converting a local timestamp to the time of the
+ *          central on a connection.
+ *
+ * @param conn Connection the timestamp is sent on.
+ * @param timestamp Local uptime in milliseconds, replaced by the central
+ * time if the clocks are synchronized.
+ *
+ * @return True if the timestamp has been converted.
+ */
+bool time_sync_convert(struct bt_conn *conn, uint32_t *timestamp);
+
+/**
+ * @brief   Function for reading the current offset estimate of a
+ *          connection.
+ *
+ * @param conn Connection of the central.
+ * @param offset Pointer filled with central minus local time in ms.
+ *
+ * @return True if the clocks are synchronized.
+ */
+bool time_sync_offset_get(struct bt_conn *conn, int32_t *offset);
+
+/** @} */
+
+#endif /* _TIME_SYNC_H__ */
@@ -0,0 +1,151 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * @ingroup nfc_writable_ndef_msg_example_warm_restart warm_restart.c
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Warm restart from state retained in RAM.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/reboot.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <nfc/t4t/ndef_file.h>
+#include <errno.h>
+
+#include "warm_restart.h"
+
+#if defined(CONFIG_CHECKPOINT_WARM_RESTART)
+
+#define RETAINED_MAGIC 0x57524d31 /* "WRM1" */
+
+/* Left alone by the C runtime, and kept by the SoC over a soft reset. */
+struct retained_block {
+	uint32_t magic;
+	uint32_t layout;     /**< Block size, changes with the firmware. */
+	uint32_t restarts;
+	uint8_t consecutive;
+	struct warm_restart_state state;
+	uint32_t ndef_len;   /**< NLEN and message covered by the CRC. */
+	uint32_t crc;
+};
+
+static __noinit struct retained_block retained;
+
+static struct warm_restart_stats stats;
+
+static uint32_t retained_crc(const uint8_t *ndef)
+{
+	uint32_t crc;
+
+	crc = crc32_ieee((const uint8_t *)&retained,
+			 offsetof(struct retained_block, crc));
+	return crc32_ieee_update(crc, ndef, retained.ndef_len);
+}
+
+bool warm_restart_take(struct warm_restart_state *state, const uint8_t *ndef,
+		       size_t size)
+{
+	bool valid;
+
+	valid = retained.magic == RETAINED_MAGIC &&
+		retained.layout == sizeof(retained) &&
+		retained.ndef_len <= size &&
+		retained.crc == retained_crc(ndef);
+	retained.magic = 0;
+
+	if (!valid) {
+		return false;
+	}
+
+	*state = retained.state;
+	stats.restarts = retained.restarts;
+	stats.consecutive = retained.consecutive;
+	stats.warm_boot = true;
+
+	return true;
+}
+
+void warm_restart_settled(void)
+{
+	stats.consecutive = 0;
+}
+
+int warm_restart(const struct warm_restart_state *state, const uint8_t *ndef,
+		 size_t size)
+{
+	uint32_t len;
+
+	if (stats.consecutive >= CONFIG_CHECKPOINT_WARM_RESTART_MAX) {
+		printk("%u warm restarts did not recover, restarting cold\n",
+		       stats.consecutive);
+		return -ELOOP;
+	}
+
+	if (size < NFC_NDEF_FILE_NLEN_FIELD_SIZE) {
+		return -EINVAL;
+	}
+
+	len = NFC_NDEF_FILE_NLEN_FIELD_SIZE + sys_get_be16(ndef);
+	if (len > size) {
+		return -EINVAL;
+	}
+
+	retained.magic = RETAINED_MAGIC;
+	retained.layout = sizeof(retained);
+	retained.restarts = stats.restarts + 1;
+	retained.consecutive = stats.consecutive + 1;
+	retained.state = *state;
+	retained.ndef_len = len;
+	retained.crc = retained_crc(ndef);
+
+	printk("Warm restart\n");
+	sys_reboot(SYS_REBOOT_WARM);
+
+	return -EIO;
+}
+
+void warm_restart_stats_get(struct warm_restart_stats *out)
+{
+	*out = stats;
+}
+
+#else
+
+bool warm_restart_take(struct warm_restart_state *state, const uint8_t *ndef,
+		       size_t size)
+{
+	ARG_UNUSED(state);
+	ARG_UNUSED(ndef);
+	ARG_UNUSED(size);
+
+	return false;
+}
+
+void warm_restart_settled(void)
+{
+}
+
+int warm_restart(const struct warm_restart_state *state, const uint8_t *ndef,
+		 size_t size)
+{
+	ARG_UNUSED(state);
+	ARG_UNUSED(ndef);
+	ARG_UNUSED(size);
+
+	return -ENOTSUP;
+}
+
+void warm_restart_stats_get(struct warm_restart_stats *out)
+{
+	*out = (struct warm_restart_stats){ 0 };
+}
+
+#endif /* CONFIG_CHECKPOINT_WARM_RESTART */
+
+/** @} */
@@ -0,0 +1,93 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _WARM_RESTART_H__
+#define _WARM_RESTART_H__
+
+/** @file
+ *
+ * @defgroup nfc_writable_ndef_msg_example_warm_restart warm_restart.h
+ * @{
+ * @ingroup nfc_writable_ndef_msg_example
+ * @brief Warm restart from state retained in RAM.
+ *
+ * Before a restart the checkpoint leaves its active category, counters and
+ * journal position in a RAM block that the C runtime does not clear,
+ * protected by a CRC that also covers the emulated NDEF file. The next
+ * boot validates the block and resumes NFC emulation from it before the
+ * NVS mount, Bluetooth and the journal, instead of rebuilding everything
+ * first.
+ */
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** State of the main loop carried over a warm restart. */
+struct warm_restart_state {
+	uint32_t next_seq;    /**< Next tap journal sequence number. */
+	uint32_t raw_reads;   /**< NDEF reads received. */
+	uint32_t taps;        /**< Taps reported. */
+	uint32_t coalesced;   /**< Reads merged into a tap. */
+	uint32_t too_soon;    /**< Reads within the re-tap interval. */
+	uint32_t nfc_events;  /**< NFC events queued by the callback. */
+	uint32_t nfc_dropped; /**< NFC events lost to a full queue. */
+	uint8_t category;     /**< Active URL category. */
+};
+
+/** Warm restart counters. */
+struct warm_restart_stats {
+	uint32_t restarts;   /**< Warm restarts since the last cold boot. */
+	uint8_t consecutive; /**< Warm restarts in a row not yet settled. */
+	bool warm_boot;      /**< This boot resumed a retained state. */
+};
+
+/**
+ * @brief   Function for taking the state retained by the last restart.
+ *
+ * @details The block is invalidated whether it was valid or not, so a
+ * later reset that did not go through warm_restart() starts cold.
+ *
+ * @param state Pointer filled with the retained state.
+ * @param ndef Emulated NDEF file, kept in RAM that is not cleared at boot.
+ * @param size Size of the NDEF file buffer.
+ *
+ * @return true if the state and the NDEF file are valid.
+ */
+bool warm_restart_take(struct warm_restart_state *state, const uint8_t *ndef,
+		       size_t size);
+
+/**
+ * @brief   Function for noting that the checkpoint is fully up again.
+ *
+ * @details Resets the count of consecutive warm restarts.
+ */
+void warm_restart_settled(void);
+
+/**
+ * @brief   Function for restarting with the state retained in RAM.
+ *
+ * @details Does not return on success. Fails when the NDEF file does not
+ * fit, or when CONFIG_CHECKPOINT_WARM_RESTART_MAX warm restarts in a row
+ * did not settle, so a persistent fault ends in a cold boot.
+ *
+ * @param state State to retain.
+ * @param ndef Emulated NDEF file, NLEN followed by the message.
+ * @param size Size of the NDEF file buffer.
+ *
+ * @return Error code.
+ */
+int warm_restart(const struct warm_restart_state *state, const uint8_t *ndef,
+		 size_t size);
+
+/**
+ * @brief   Function for reading the warm restart counters.
+ *
+ * @param stats Pointer filled with the counters.
+ */
+void warm_restart_stats_get(struct warm_restart_stats *stats);
+
+/** @} */
+
+#endif /* _WARM_RESTART_H__ */
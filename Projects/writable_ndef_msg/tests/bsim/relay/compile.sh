@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+
+# Builds the relay test image for the nRF52 BabbleSim board.
+# ZEPHYR_BASE, BSIM_OUT_PATH and BSIM_COMPONENTS_PATH must be set.
+
+set -ue
+
+dir="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+
+: "${ZEPHYR_BASE:?ZEPHYR_BASE must be defined}"
+
+source ${ZEPHYR_BASE}/tests/bsim/compile.source
+
+app_root="$(cd "${dir}/../../.." && pwd)" app=tests/bsim/relay \
+  exe_name=bs_${BOARD_TS}_checkpoint_relay compile
+
+wait_for_background_jobs
@@ -0,0 +1,354 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * BabbleSim test of the tap relay. Origins flood taps with no central
+ * attached, hops only relay, and the sink stands for a checkpoint with a
+ * central: it counts what reaches it per origin, checks that nothing is
+ * delivered twice and derives the per-hop latency from age_ms.
+ *
+ * Test arguments (-argstest), the same for every device:
+ *   taps=N       taps flooded by each origin, default 40
+ *   origins=N    origin devices in the simulation, default 1
+ *   min_ratio=P  delivered percentage required per origin, default 90
+ *   min_hops=N   hops required for every delivery, default 1
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bs_types.h"
+#include "bs_tracing.h"
+#include "time_machine.h"
+#include "bstests.h"
+#include "bsim_args_runner.h"
+
+#include "relay.h"
+
+extern enum bst_result_t bst_result;
+
+#define FAIL(...)					\
+	do {						\
+		bst_result = Failed;			\
+		bs_trace_error_time_line(__VA_ARGS__);	\
+	} while (0)
+
+#define PASS(...)					\
+	do {						\
+		bst_result = Passed;			\
+		bs_trace_info_time(1, __VA_ARGS__);	\
+	} while (0)
+
+/** Simulated time after which a device that did not pass fails. */
+#define WAIT_TIME (120 * 1000000)
+
+#define TAP_INTERVAL_MS 250
+#define SETTLE_MS 1000  /**< Time for every device to start scanning. */
+#define DRAIN_MS 5000   /**< Time for the last taps to cross the chain. */
+#define TAPS_MAX 256
+#define ORIGINS_MAX 8
+
+static uint32_t taps = 40;
+static uint32_t origins = 1;
+static uint32_t min_ratio = 90;
+static uint32_t min_hops = 1;
+
+/** What the sink received from one origin. */
+struct origin_rx {
+	bt_addr_le_t addr;
+	uint32_t delivered;
+	uint32_t twice;        /**< Sequence numbers delivered again. */
+	uint32_t hops_total;
+	uint32_t hops_min;
+	uint32_t age_ms_total;
+	ATOMIC_DEFINE(seen, TAPS_MAX + 1);
+};
+
+static struct origin_rx rx[ORIGINS_MAX];
+static uint32_t rx_count;
+static uint32_t rx_invalid;
+static bool sink;
+
+static void test_args(int argc, char *argv[])
+{
+	for (int i = 0; i < argc; i++) {
+		char *val = strchr(argv[i], '=');
+
+		if (!val) {
+			continue;
+		}
+		val++;
+
+		if (!strncmp(argv[i], "taps=", 5)) {
+			taps = MIN(strtoul(val, NULL, 0), TAPS_MAX);
+		} else if (!strncmp(argv[i], "origins=", 8)) {
+			origins = MIN(strtoul(val, NULL, 0), ORIGINS_MAX);
+		} else if (!strncmp(argv[i], "min_ratio=", 10)) {
+			min_ratio = strtoul(val, NULL, 0);
+		} else if (!strncmp(argv[i], "min_hops=", 9)) {
+			min_hops = strtoul(val, NULL, 0);
+		}
+	}
+}
+
+static struct origin_rx *origin_find(const bt_addr_le_t *addr)
+{
+	for (uint32_t i = 0; i < rx_count; i++) {
+		if (!bt_addr_le_cmp(&rx[i].addr, addr)) {
+			return &rx[i];
+		}
+	}
+
+	if (rx_count == ARRAY_SIZE(rx)) {
+		return NULL;
+	}
+
+	bt_addr_le_copy(&rx[rx_count].addr, addr);
+	rx[rx_count].hops_min = UINT32_MAX;
+
+	return &rx[rx_count++];
+}
+
+/* Only the sink has a central attached. */
+static int deliver(const struct relay_pdu *pdu)
+{
+	uint32_t seq = sys_le32_to_cpu(pdu->seq);
+	struct origin_rx *o;
+
+	if (!sink) {
+		return 0;
+	}
+
+	o = origin_find(&pdu->origin);
+	if (!o || seq == 0 || seq > taps) {
+		rx_invalid++;
+		return 1;
+	}
+
+	if (atomic_test_and_set_bit(o->seen, seq)) {
+		o->twice++;
+		return 1;
+	}
+
+	o->delivered++;
+	o->hops_total += pdu->hops;
+	o->hops_min = MIN(o->hops_min, pdu->hops);
+	o->age_ms_total += sys_le16_to_cpu(pdu->age_ms);
+
+	return 1;
+}
+
+/* Distinct identity per simulated device, so origins tell apart. */
+static void relay_start(void)
+{
+	bt_addr_le_t addr = {
+		.type = BT_ADDR_LE_RANDOM,
+		.a.val = { get_device_nbr(), 0x00, 0x00, 0x00, 0x00, 0xc0 },
+	};
+	int err;
+
+	err = bt_id_create(&addr, NULL);
+	if (err < 0) {
+		FAIL("Identity not set (err %d)\n", err);
+		return;
+	}
+
+	err = bt_enable(NULL);
+	if (err) {
+		FAIL("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	err = relay_init(deliver);
+	if (err) {
+		FAIL("Relay init failed (err %d)\n", err);
+		return;
+	}
+
+	k_msleep(SETTLE_MS);
+}
+
+static uint32_t run_ms(void)
+{
+	return SETTLE_MS + taps * TAP_INTERVAL_MS + DRAIN_MS;
+}
+
+static void stats_print(const char *role)
+{
+	struct relay_stats st;
+
+	relay_stats_get(&st);
+	printk("%s %u: originated %u received %u duplicates %u forwarded %u "
+	       "delivered %u expired %u dropped %u\n", role, get_device_nbr(),
+	       st.originated, st.received, st.duplicates, st.forwarded,
+	       st.delivered, st.expired, st.dropped);
+}
+
+static void test_origin_main(void)
+{
+	struct relay_stats st;
+
+	relay_start();
+
+	for (uint32_t seq = 1; seq <= taps; seq++) {
+		relay_tap(seq, seq % 4, k_uptime_get_32());
+		k_msleep(TAP_INTERVAL_MS);
+	}
+	k_msleep(DRAIN_MS);
+
+	stats_print("origin");
+	relay_stats_get(&st);
+	if (st.originated != taps) {
+		FAIL("Originated %u of %u taps\n", st.originated, taps);
+		return;
+	}
+	if (st.delivered) {
+		FAIL("Origin without a central delivered %u taps\n",
+		     st.delivered);
+		return;
+	}
+
+	PASS("Origin passed\n");
+}
+
+static void test_hop_main(void)
+{
+	struct relay_stats st;
+
+	relay_start();
+	k_msleep(run_ms() - SETTLE_MS);
+
+	stats_print("hop");
+	relay_stats_get(&st);
+	if (!st.forwarded) {
+		FAIL("Nothing forwarded\n");
+		return;
+	}
+	/* Every tap is forwarded once, later copies are suppressed. */
+	if (st.forwarded > taps * origins) {
+		FAIL("Forwarded %u PDUs for %u taps\n", st.forwarded,
+		     taps * origins);
+		return;
+	}
+
+	PASS("Hop passed\n");
+}
+
+static void test_sink_main(void)
+{
+	bool ok = true;
+
+	sink = true;
+	relay_start();
+	k_msleep(run_ms() - SETTLE_MS);
+
+	stats_print("sink");
+	printk("origin,delivered,originated,ratio_pct,twice,hops_min,"
+	       "hops_mean_x100,ms_per_hop\n");
+
+	for (uint32_t i = 0; i < rx_count; i++) {
+		struct origin_rx *o = &rx[i];
+		char addr[BT_ADDR_LE_STR_LEN];
+		uint32_t ratio = o->delivered * 100 / taps;
+
+		bt_addr_le_to_str(&o->addr, addr, sizeof(addr));
+		printk("%s,%u,%u,%u,%u,%u,%u,%u\n", addr, o->delivered, taps,
+		       ratio, o->twice, o->delivered ? o->hops_min : 0,
+		       o->delivered ? o->hops_total * 100 / o->delivered : 0,
+		       o->hops_total ? o->age_ms_total / o->hops_total : 0);
+
+		if (ratio < min_ratio) {
+			printk("%s: %u%% delivered, below %u%%\n", addr, ratio,
+			       min_ratio);
+			ok = false;
+		}
+		if (o->twice) {
+			printk("%s: %u taps delivered twice\n", addr, o->twice);
+			ok = false;
+		}
+		if (o->delivered && o->hops_min < min_hops) {
+			printk("%s: delivered after %u hops, expected %u\n",
+			       addr, o->hops_min, min_hops);
+			ok = false;
+		}
+	}
+
+	if (rx_count != origins || rx_invalid) {
+		FAIL("Heard %u of %u origins, %u invalid PDUs\n", rx_count,
+		     origins, rx_invalid);
+		return;
+	}
+	if (!ok) {
+		FAIL("Sink failed\n");
+		return;
+	}
+
+	PASS("Sink passed\n");
+}
+
+static void test_init(void)
+{
+	bst_ticker_set_next_tick_absolute(WAIT_TIME);
+	bst_result = In_progress;
+}
+
+static void test_tick(bs_time_t HW_device_time)
+{
+	ARG_UNUSED(HW_device_time);
+
+	if (bst_result != Passed) {
+		FAIL("Test timed out\n");
+	}
+}
+
+static const struct bst_test_instance test_def[] = {
+	{
+		.test_id = "relay_origin",
+		.test_descr = "Floods taps with no central attached",
+		.test_args_f = test_args,
+		.test_post_init_f = test_init,
+		.test_tick_f = test_tick,
+		.test_main_f = test_origin_main,
+	},
+	{
+		.test_id = "relay_hop",
+		.test_descr = "Relays taps with no central attached",
+		.test_args_f = test_args,
+		.test_post_init_f = test_init,
+		.test_tick_f = test_tick,
+		.test_main_f = test_hop_main,
+	},
+	{
+		.test_id = "relay_sink",
+		.test_descr = "Delivers relayed taps and checks them per origin",
+		.test_args_f = test_args,
+		.test_post_init_f = test_init,
+		.test_tick_f = test_tick,
+		.test_main_f = test_sink_main,
+	},
+	BSTEST_END_MARKER
+};
+
+static struct bst_test_list *test_relay_install(struct bst_test_list *tests)
+{
+	return bst_add_tests(tests, test_def);
+}
+
+bst_test_install_t test_installers[] = {
+	test_relay_install,
+	NULL
+};
+
+int main(void)
+{
+	bst_main();
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+
+# Two origins without a central flood taps along a chain of relays to the
+# only checkpoint with a central, three hops away. Every tap must arrive
+# once, after at least three hops, from both origins.
+
+source ${ZEPHYR_BASE}/tests/bsim/sh_common.source
+
+simulation_id="checkpoint_relay_chain"
+verbosity_level=2
+EXECUTE_TIMEOUT=240
+test_args="-argstest taps=40 origins=2 min_ratio=90 min_hops=3"
+
+dir="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+
+cd ${BSIM_OUT_PATH}/bin
+
+exe=./bs_${BOARD_TS}_checkpoint_relay
+
+Execute ${exe} -v=${verbosity_level} -s=${simulation_id} -d=0 \
+  -testid=relay_origin -RealEncryption=0 ${test_args}
+Execute ${exe} -v=${verbosity_level} -s=${simulation_id} -d=1 \
+  -testid=relay_hop -RealEncryption=0 ${test_args}
+Execute ${exe} -v=${verbosity_level} -s=${simulation_id} -d=2 \
+  -testid=relay_hop -RealEncryption=0 ${test_args}
+Execute ${exe} -v=${verbosity_level} -s=${simulation_id} -d=3 \
+  -testid=relay_sink -RealEncryption=0 ${test_args}
+Execute ${exe} -v=${verbosity_level} -s=${simulation_id} -d=4 \
+  -testid=relay_origin -RealEncryption=0 ${test_args}
+
+Execute ./bs_2G4_phy_v1 -v=${verbosity_level} -s=${simulation_id} -D=5 \
+  -sim_length=130e6 -channel=multiatt -argschannel -at=120 \
+  -file=${dir}/chain_att.txt
+
+wait_for_background_jobs
@@ -0,0 +1,214 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * Endurance run of the NDEF file storage on the flash simulator: category
+ * switches and phone updates as a checkpoint sees them, with the worst
+ * nvs_write() latency, the erase count per sector and the flash lifetime
+ * they project to.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <nfc/ndef/uri_msg.h>
+
+#include "ndef_file_m.h"
+
+#define FILE_SIZE CONFIG_NDEF_FILE_SIZE
+#define NLEN_SIZE 2
+
+#define STORAGE_DEVICE FIXED_PARTITION_DEVICE(storage_partition)
+#define STORAGE_OFFSET FIXED_PARTITION_OFFSET(storage_partition)
+#define STORAGE_SIZE   FIXED_PARTITION_SIZE(storage_partition)
+
+/* Same geometry as the file system of ndef_file_m.c. */
+#define SECTOR_SIZE  (DT_PROP(DT_CHOSEN(zephyr_flash), erase_block_size))
+#define SECTOR_COUNT CONFIG_NDEF_FILE_NVS_SECTOR_COUNT
+
+/* NVS allocation table entry. The last one of a sector is written when the
+ * sector is closed, the one before it is the first written after an erase.
+ */
+#define ATE_SIZE 8
+
+static uint8_t buf[FILE_SIZE];
+static uint8_t phone[FILE_SIZE];
+
+static uint32_t erases[SECTOR_COUNT];
+static int write_sector = -1;
+
+static bool ate_erased(off_t sector, off_t offset)
+{
+	uint8_t ate[ATE_SIZE];
+
+	zassert_ok(flash_read(STORAGE_DEVICE, STORAGE_OFFSET +
+			      sector * SECTOR_SIZE + offset, ate, sizeof(ate)));
+	for (size_t i = 0; i < sizeof(ate); i++) {
+		if (ate[i] != 0xff) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* The sector NVS writes to: written since its erase, not closed yet. */
+static int write_sector_find(void)
+{
+	for (int s = 0; s < SECTOR_COUNT; s++) {
+		if (ate_erased(s, SECTOR_SIZE - ATE_SIZE) &&
+		    !ate_erased(s, SECTOR_SIZE - 2 * ATE_SIZE)) {
+			return s;
+		}
+	}
+
+	return -1;
+}
+
+/* NVS moves to the next sector when the write sector is closed, and
+ * garbage collects and erases the sector after that one. Counting the
+ * moves gives the erases per sector without hooking the flash driver.
+ */
+static void erases_update(void)
+{
+	int s = write_sector_find();
+
+	zassert_true(s >= 0, "no NVS write sector");
+	if (write_sector >= 0) {
+		while (write_sector != s) {
+			write_sector = (write_sector + 1) % SECTOR_COUNT;
+			erases[(write_sector + 1) % SECTOR_COUNT]++;
+		}
+	}
+	write_sector = s;
+}
+
+static uint32_t erases_max(void)
+{
+	uint32_t max = 0;
+
+	for (int s = 0; s < SECTOR_COUNT; s++) {
+		max = MAX(max, erases[s]);
+	}
+
+	return max;
+}
+
+/* Encodes a message of the default size that differs on every write, as
+ * the ones written by phones do.
+ */
+static uint32_t phone_file_encode(uint32_t cycle)
+{
+	char url[32];
+	uint32_t len = FILE_SIZE - NLEN_SIZE;
+
+	snprintk(url, sizeof(url), "example.com/tap/%08u", cycle);
+	zassert_ok(nfc_ndef_uri_msg_encode(NFC_URI_HTTPS, url, strlen(url),
+					   phone + NLEN_SIZE, &len));
+	sys_put_be16(len, phone);
+
+	return len + NLEN_SIZE;
+}
+
+static void idle(void)
+{
+	/* Leave the garbage collection queue its chance, as a phone does. */
+	k_msleep(CONFIG_NDEF_FILE_ENDURANCE_IDLE_MS);
+	erases_update();
+}
+
+static void report(const char *tag, uint32_t cycle)
+{
+	struct ndef_file_stats st;
+
+	ndef_file_stats_get(&st);
+	TC_PRINT("%s,%u,%u,%u,%u,%u,%u,%u\n", tag, cycle, st.writes,
+		 st.write_worst_us, st.idle_gc, st.inline_gc, st.gc_worst_us,
+		 erases_max());
+}
+
+static void *endurance_setup(void)
+{
+	zassert_ok(flash_erase(STORAGE_DEVICE, STORAGE_OFFSET, STORAGE_SIZE));
+	zassert_ok(ndef_file_setup());
+
+	return NULL;
+}
+
+ZTEST_SUITE(ndef_file_endurance, NULL, endurance_setup, NULL, NULL, NULL);
+
+ZTEST(ndef_file_endurance, test_switch_update_cycles)
+{
+	const uint32_t cycles = CONFIG_NDEF_FILE_ENDURANCE_CYCLES;
+	struct ndef_file_stats st;
+	uint32_t worst;
+	uint64_t lifetime;
+	uint32_t size;
+	int category = 0;
+
+	TC_PRINT("endurance,cycle,writes,write_worst_us,idle_gc,inline_gc,"
+		 "gc_worst_us,erases_max\n");
+
+	for (uint32_t cycle = 0; cycle < cycles; cycle++) {
+		category = cycle % NDEF_FILE_CATEGORIES;
+
+		/* Category switch: the default message of the new category
+		 * replaces what a phone wrote to it last time around.
+		 */
+		zassert_true(ndef_restore_default(category, buf,
+						  sizeof(buf)) > 0,
+			     "cycle %u: switch not stored", cycle);
+		idle();
+
+		/* Phone update of the active category. */
+		size = phone_file_encode(cycle);
+		zassert_true(ndef_file_update(category, phone, size) > 0,
+			     "cycle %u: update not stored", cycle);
+		idle();
+
+		if ((cycle + 1) % CONFIG_NDEF_FILE_ENDURANCE_REPORT_CYCLES == 0) {
+			report("endurance", cycle + 1);
+		}
+	}
+
+	/* The last update is still there. */
+	memset(buf, 0, sizeof(buf));
+	zassert_equal(ndef_file_load(category, buf, sizeof(buf)), size);
+	zassert_mem_equal(buf, phone, size);
+
+	ndef_file_stats_get(&st);
+	for (int s = 0; s < SECTOR_COUNT; s++) {
+		TC_PRINT("erases,%d,%u\n", s, erases[s]);
+	}
+
+	worst = erases_max();
+	zassert_true(worst > 0, "run too short to fill a sector");
+	lifetime = (uint64_t)CONFIG_NDEF_FILE_ENDURANCE_ERASE_CYCLES *
+		   cycles / worst;
+	TC_PRINT("lifetime,%u cycles per erase,%llu cycles,%llu days at %u "
+		 "cycles per day\n", cycles / worst, lifetime,
+		 lifetime / CONFIG_NDEF_FILE_ENDURANCE_CYCLES_PER_DAY,
+		 CONFIG_NDEF_FILE_ENDURANCE_CYCLES_PER_DAY);
+	TC_PRINT("write worst %u us, gc worst %u us, %u idle gc, %u inline gc\n",
+		 st.write_worst_us, st.gc_worst_us, st.idle_gc, st.inline_gc);
+
+	/* The erases happen on the idle queue, never inside a write that a
+	 * category switch or a phone waits for.
+	 */
+	zassert_equal(st.inline_gc, 0, "%u writes collected a sector",
+		      st.inline_gc);
+	zassert_true(st.write_worst_us < CONFIG_FLASH_SIMULATOR_MIN_ERASE_TIME_US,
+		     "a write took %u us, as long as a page erase",
+		     st.write_worst_us);
+
+	/* Sectors are used in turn, so they wear evenly. */
+	for (int s = 0; s < SECTOR_COUNT; s++) {
+		zassert_true(worst - erases[s] <= 1, "sector %d erased %u times,"
+			     " another %u times", s, erases[s], worst);
+	}
+}
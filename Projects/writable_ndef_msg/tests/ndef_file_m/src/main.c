@@ -0,0 +1,357 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *
+ * Tests of the NDEF file storage on the flash simulator: default messages,
+ * load, update and restore for every category slot, the storage benchmark
+ * and the NVS mount time as the flash fills.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <nfc/t4t/ndef_file.h>
+#include <nfc/ndef/uri_msg.h>
+
+#include "ndef_file_m.h"
+
+#define FILE_SIZE CONFIG_NDEF_FILE_SIZE
+#define NLEN_SIZE 2
+
+#define STORAGE_DEVICE FIXED_PARTITION_DEVICE(storage_partition)
+#define STORAGE_OFFSET FIXED_PARTITION_OFFSET(storage_partition)
+#define STORAGE_SIZE   FIXED_PARTITION_SIZE(storage_partition)
+
+#define FILL_DEVICE FIXED_PARTITION_DEVICE(fill_partition)
+#define FILL_OFFSET FIXED_PARTITION_OFFSET(fill_partition)
+#define FILL_SIZE   FIXED_PARTITION_SIZE(fill_partition)
+
+/* Same geometry as the file system of ndef_file_m.c. */
+#define SECTOR_SIZE  (DT_PROP(DT_CHOSEN(zephyr_flash), erase_block_size))
+#define SECTOR_COUNT CONFIG_NDEF_FILE_NVS_SECTOR_COUNT
+
+BUILD_ASSERT(SECTOR_COUNT * SECTOR_SIZE <= FILL_SIZE,
+	     "The fill partition must hold the NDEF file system");
+
+/* The default URLs of ndef_file_m.c, encoded independently here. */
+static const char *const default_urls[NDEF_FILE_CATEGORIES] = {
+	"ik-polls-project.herokuapp.com/polls/deepthoughts",
+	"sites.google.com/view/group18finalproject/about-the-project",
+	"forms.gle/2ra6XanJvxNrh9xTA",
+	"forms.gle/Gs5diyMgjs6YHkmNA",
+};
+
+struct ndef_file_fixture {
+	/* Results of loading every slot from erased flash, in setup. */
+	int first_load_err[NDEF_FILE_CATEGORIES];
+	uint8_t first_load[NDEF_FILE_CATEGORIES][FILE_SIZE];
+};
+
+static struct ndef_file_fixture fixture;
+static uint8_t buf[FILE_SIZE];
+static uint8_t expect[FILE_SIZE];
+
+/* Encodes the NDEF file expected for an HTTPS URL, NLEN included. */
+static uint32_t file_encode(const char *url, uint8_t *file)
+{
+	uint32_t len = FILE_SIZE - NLEN_SIZE;
+	int err;
+
+	memset(file, 0, FILE_SIZE);
+	err = nfc_ndef_uri_msg_encode(NFC_URI_HTTPS, url, strlen(url),
+				      file + NLEN_SIZE, &len);
+	zassert_ok(err, "URI message of %s not encoded", url);
+	sys_put_be16(len, file);
+
+	return len + NLEN_SIZE;
+}
+
+/* Encodes a message that differs on every write, NVS skips writes of
+ * the data it already holds.
+ */
+static uint32_t tap_file_encode(int n, uint8_t *file)
+{
+	char url[32];
+
+	snprintk(url, sizeof(url), "example.com/tap/%06d", n);
+
+	return file_encode(url, file);
+}
+
+/* NVS ID of the slot written by the nth write on the fill partition. */
+static uint16_t fill_id(int n)
+{
+	return 1 + (n % NDEF_FILE_CATEGORIES) * FILE_SIZE;
+}
+
+static void assert_slot(int index, const char *url)
+{
+	uint32_t size = file_encode(url, expect);
+	int err;
+
+	memset(buf, 0, sizeof(buf));
+	err = ndef_file_load(index, buf, sizeof(buf));
+	zassert_equal(err, size, "slot %d: loaded %d bytes, expected %u",
+		      index, err, size);
+	zassert_mem_equal(buf, expect, size, "slot %d: not %s", index, url);
+}
+
+static void *ndef_file_setup_suite(void)
+{
+	int err;
+
+	/* The simulator flash persists between runs, start from blank. */
+	err = flash_erase(STORAGE_DEVICE, STORAGE_OFFSET, STORAGE_SIZE);
+	zassert_ok(err, "storage partition not erased");
+
+	err = ndef_file_setup();
+	zassert_ok(err, "ndef_file_setup failed");
+
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		fixture.first_load_err[i] =
+			ndef_file_load(i, fixture.first_load[i], FILE_SIZE);
+	}
+
+	return &fixture;
+}
+
+static void ndef_file_before(void *f)
+{
+	ARG_UNUSED(f);
+
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		zassert_true(ndef_restore_default(i, buf, sizeof(buf)) >= 0,
+			     "slot %d not restored", i);
+	}
+}
+
+ZTEST_SUITE(ndef_file_m, NULL, ndef_file_setup_suite, ndef_file_before,
+	    NULL, NULL);
+
+ZTEST(ndef_file_m, test_default_message)
+{
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		uint32_t size = sizeof(buf);
+		uint32_t msg_size;
+		uint32_t expect_size = file_encode(default_urls[i], expect);
+
+		memset(buf, 0, sizeof(buf));
+		zassert_ok(ndef_file_default_message(i, buf, &size));
+		zassert_equal(size, expect_size, "slot %d: file size %u",
+			      i, size);
+		zassert_equal(sys_get_be16(buf), size - NLEN_SIZE,
+			      "slot %d: NLEN does not match the message", i);
+		zassert_mem_equal(buf, expect, size, "slot %d", i);
+
+		zassert_ok(ndef_file_default_size(i, &msg_size));
+		zassert_equal(msg_size, size - NLEN_SIZE,
+			      "slot %d: default size %u", i, msg_size);
+	}
+}
+
+ZTEST_F(ndef_file_m, test_load_creates_default)
+{
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		uint32_t size = file_encode(default_urls[i], expect);
+
+		/* Nothing stored yet: the default is written and returned. */
+		zassert_equal(fixture->first_load_err[i], size,
+			      "slot %d: first load returned %d", i,
+			      fixture->first_load_err[i]);
+		zassert_mem_equal(fixture->first_load[i], expect, size,
+				  "slot %d", i);
+
+		/* Stored now: the same bytes come back from flash. */
+		assert_slot(i, default_urls[i]);
+	}
+}
+
+ZTEST(ndef_file_m, test_update_load)
+{
+	static const char *const written[NDEF_FILE_CATEGORIES] = {
+		"example.com/written/0",
+		"example.com/written/category/1",
+		"example.com/2",
+		"example.com/written/by/a/phone/3",
+	};
+
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		uint32_t size = file_encode(written[i], expect);
+
+		zassert_true(ndef_file_update(i, expect, size) >= 0,
+			     "slot %d not updated", i);
+		assert_slot(i, written[i]);
+
+		/* The other slots keep what they had. */
+		for (int j = 0; j < NDEF_FILE_CATEGORIES; j++) {
+			if (j != i) {
+				assert_slot(j, j < i ? written[j] :
+						       default_urls[j]);
+			}
+		}
+	}
+}
+
+ZTEST(ndef_file_m, test_restore_default)
+{
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		uint32_t size = file_encode("example.com/overwritten", expect);
+
+		zassert_true(ndef_file_update(i, expect, size) >= 0);
+		assert_slot(i, "example.com/overwritten");
+
+		zassert_true(ndef_restore_default(i, buf, sizeof(buf)) > 0,
+			     "slot %d: default not written", i);
+		assert_slot(i, default_urls[i]);
+	}
+}
+
+ZTEST(ndef_file_m, test_update_survives_gc)
+{
+	struct ndef_file_stats before;
+	struct ndef_file_stats after;
+	uint32_t size = tap_file_encode(0, expect);
+	int rounds = 4 * SECTOR_COUNT * SECTOR_SIZE / size;
+
+	ndef_file_stats_get(&before);
+
+	/* Enough writes to cycle every sector more than once. */
+	for (int n = 0; n < rounds; n++) {
+		tap_file_encode(n, expect);
+		zassert_true(ndef_file_update(n % NDEF_FILE_CATEGORIES,
+					      expect, size) > 0);
+		/* Let the idle queue close the sector ahead of the writes. */
+		k_msleep(1);
+	}
+
+	ndef_file_stats_get(&after);
+	zassert_true(after.idle_gc > before.idle_gc,
+		     "no sector collected from the idle queue");
+	for (int n = rounds - NDEF_FILE_CATEGORIES; n < rounds; n++) {
+		tap_file_encode(n, expect);
+		memset(buf, 0, sizeof(buf));
+		zassert_equal(ndef_file_load(n % NDEF_FILE_CATEGORIES, buf,
+					     sizeof(buf)), size);
+		zassert_mem_equal(buf, expect, size, "write %d lost", n);
+	}
+}
+
+static void bench_print(const char *name,
+			const struct ndef_file_bench_stat *st)
+{
+	TC_PRINT("bench,%s,%u,%u,%u,%u,%u\n", name, st->count, st->min_us,
+		 st->count ? st->total_us / st->count : 0, st->max_us,
+		 st->bytes);
+}
+
+/* Same CSV as "checkpoint bench", so bench_diff.py compares the captures
+ * of two test runs.
+ */
+ZTEST(ndef_file_m, test_bench)
+{
+	static const char *const encode_name[NDEF_FILE_CATEGORIES] = {
+		"encode0", "encode1", "encode2", "encode3",
+	};
+	const uint32_t rounds = 16;
+	struct ndef_file_bench bench;
+	struct ndef_file_stats st;
+	uint32_t size;
+
+	zassert_ok(ndef_file_bench_run(rounds, &bench));
+
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		size = file_encode(default_urls[i], expect);
+		zassert_equal(bench.encode[i].count, rounds);
+		zassert_equal(bench.encode[i].bytes, size, "encode%d", i);
+		zassert_true(bench.encode[i].min_us <= bench.encode[i].max_us);
+	}
+	zassert_equal(bench.write.count, rounds);
+	zassert_equal(bench.read.count, rounds);
+	zassert_equal(bench.write.bytes, size, "not the last message encoded");
+	zassert_equal(bench.read.bytes, size);
+
+	/* The scratch record is gone, the slots are untouched. */
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		assert_slot(i, default_urls[i]);
+	}
+
+	ndef_file_stats_get(&st);
+	TC_PRINT("bench,name,count,min_us,mean_us,max_us,bytes\n");
+	TC_PRINT("bench,mount,1,%u,%u,%u,%u\n", st.mount_us, st.mount_us,
+		 st.mount_us, st.mount_free);
+	for (int i = 0; i < NDEF_FILE_CATEGORIES; i++) {
+		bench_print(encode_name[i], &bench.encode[i]);
+	}
+	bench_print("nvs_write", &bench.write);
+	bench_print("nvs_read", &bench.read);
+}
+
+/* Mounts a file system with the geometry of the NDEF file storage on the
+ * fill partition, returns the mount duration.
+ */
+static uint32_t fill_mount(struct nvs_fs *fs)
+{
+	uint32_t start;
+
+	memset(fs, 0, sizeof(*fs));
+	fs->flash_device = FILL_DEVICE;
+	fs->offset = FILL_OFFSET;
+	fs->sector_size = SECTOR_SIZE;
+	fs->sector_count = SECTOR_COUNT;
+
+	start = k_cycle_get_32();
+	zassert_ok(nvs_mount(fs), "fill partition not mounted");
+
+	return k_cyc_to_us_ceil32(k_cycle_get_32() - start);
+}
+
+ZTEST(ndef_file_m, test_mount_time_fill)
+{
+	struct nvs_fs fs;
+	uint32_t size = tap_file_encode(0, expect);
+	/* Fill every sector twice over, so the mounts after the first
+	 * garbage collection are measured too.
+	 */
+	int writes = 2 * SECTOR_COUNT * SECTOR_SIZE / (size + 8);
+	uint32_t empty_us;
+	uint32_t full_us = 0;
+
+	zassert_ok(flash_erase(FILL_DEVICE, FILL_OFFSET, FILL_SIZE));
+
+	empty_us = fill_mount(&fs);
+	TC_PRINT("mount,writes,free_bytes,mount_us\n");
+	TC_PRINT("mount,0,%d,%u\n", (int)nvs_calc_free_space(&fs), empty_us);
+
+	/* Write the category slots in turn, as checkpoints do, and remount
+	 * after each write.
+	 */
+	for (int n = 0; n < writes; n++) {
+		uint32_t mount_us;
+
+		tap_file_encode(n, expect);
+		zassert_true(nvs_write(&fs, fill_id(n), expect, size) > 0);
+
+		mount_us = fill_mount(&fs);
+		full_us = MAX(full_us, mount_us);
+		TC_PRINT("mount,%d,%d,%u\n", n + 1,
+			 (int)nvs_calc_free_space(&fs), mount_us);
+	}
+
+	/* Reported only, timing is not asserted on. */
+	TC_PRINT("mount empty %u us, worst %u us\n", empty_us, full_us);
+
+	/* The remounted file system still holds the last write per slot. */
+	for (int n = writes - NDEF_FILE_CATEGORIES; n < writes; n++) {
+		tap_file_encode(n, expect);
+		memset(buf, 0, sizeof(buf));
+		zassert_equal(nvs_read(&fs, fill_id(n), buf, sizeof(buf)),
+			      size);
+		zassert_mem_equal(buf, expect, size, "write %d lost", n);
+	}
+}